@@ -0,0 +1,49 @@
+#include "arena.h"
+
+NodeArena::~NodeArena() {
+  while (first_) {
+    Block* next = first_->next;
+    ::operator delete(first_);
+    first_ = next;
+  }
+}
+
+void NodeArena::reset() {
+  if (first_)
+    useBlock(first_);
+}
+
+void NodeArena::useBlock(Block* block) {
+  current_ = block;
+  cursor_ = blockData(block);
+  limit_ = cursor_ + block->size;
+}
+
+void* NodeArena::allocateSlow(const std::size_t size) {
+  // Blocks left over from before the last reset are reused first
+  while (current_ && current_->next) {
+    useBlock(current_->next);
+
+    if (static_cast<std::size_t>(limit_ - cursor_) >= size)
+      return allocate(size);
+  }
+
+  const std::size_t blockSize = size > nextBlockSize_ ? size : nextBlockSize_;
+  if (nextBlockSize_ < maxBlockSize)
+    nextBlockSize_*= 2;
+
+  Block* block = static_cast<Block*>(::operator new(headerSize + blockSize));
+  block->next = nullptr;
+  block->size = blockSize;
+
+  ++heapAllocations_;
+  bytesReserved_+= blockSize;
+
+  if (current_)
+    current_->next = block;
+  else
+    first_ = block;
+
+  useBlock(block);
+  return allocate(size);
+}
@@ -0,0 +1,81 @@
+#ifndef __ARENA_H__
+#define __ARENA_H__
+
+#include <cstddef>
+#include <new>
+#include <utility>
+
+/* Bump allocator for tree nodes. Memory is taken from the heap in
+   blocks and is only returned on destruction: reset() rewinds to the
+   first block in O(1), so a reused arena stops touching the heap once
+   it has grown to fit the largest expression. Objects are never
+   destructed, which is fine for nodes as they hold no resources. */
+class NodeArena {
+public:
+  NodeArena() = default;
+  ~NodeArena();
+  NodeArena(const NodeArena&) = delete;
+  NodeArena& operator=(const NodeArena&) = delete;
+
+  template <typename T, typename... Args>
+  T* create(Args&&... args) {
+    ++objectsCreated_;
+    return new (allocate(sizeof(T))) T(std::forward<Args>(args)...);
+  }
+
+  void reset();
+
+  std::size_t getHeapAllocations() const {
+    return heapAllocations_;
+  }
+
+  std::size_t getBytesReserved() const {
+    return bytesReserved_;
+  }
+
+  // Over the arena's whole life, resets notwithstanding
+  std::size_t getObjectsCreated() const {
+    return objectsCreated_;
+  }
+
+private:
+  struct Block {
+    Block* next;
+    std::size_t size;
+  };
+
+  static const std::size_t alignment = alignof(std::max_align_t);
+  static const std::size_t headerSize = (sizeof(Block) + alignment - 1) & ~(alignment - 1);
+  static const std::size_t initialBlockSize = 4096;
+  static const std::size_t maxBlockSize = 1 << 20;
+
+  static char* blockData(Block* block) {
+    return reinterpret_cast<char*>(block) + headerSize;
+  }
+
+  void* allocate(std::size_t size) {
+    size = (size + alignment - 1) & ~(alignment - 1);
+
+    if (static_cast<std::size_t>(limit_ - cursor_) < size)
+      return allocateSlow(size);
+
+    void* result = cursor_;
+    cursor_+= size;
+    return result;
+  }
+
+  void* allocateSlow(const std::size_t);
+  void useBlock(Block*);
+
+  Block* first_ = nullptr;
+  Block* current_ = nullptr;
+  char* cursor_ = nullptr;
+  char* limit_ = nullptr;
+
+  std::size_t nextBlockSize_ = initialBlockSize;
+  std::size_t heapAllocations_ = 0;
+  std::size_t bytesReserved_ = 0;
+  std::size_t objectsCreated_ = 0;
+};
+
+#endif
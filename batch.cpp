@@ -0,0 +1,144 @@
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "batch.h"
+#include "evaluator.h"
+
+namespace {
+
+struct ChunkResult {
+  std::vector<OutputSegment> segments;
+  bool ready = false;
+};
+
+}
+
+static void appendLine(std::vector<OutputSegment>& segments, const bool error, const std::string& line) {
+  if (segments.empty() || segments.back().error != error)
+    segments.push_back({ error, std::string() });
+
+  segments.back().text+= line;
+  segments.back().text.push_back('\n');
+}
+
+void evaluateChunk(const char* pos, const char* end, LineEvaluator& evaluator,
+		   std::vector<OutputSegment>& segments) {
+  std::string text;
+
+  while (pos != end) {
+    switch (evaluator.evaluateLine(pos, end, text)) {
+    case LineEvaluator::Outcome::Result: appendLine(segments, false, text); break;
+    case LineEvaluator::Outcome::Error: appendLine(segments, true, text); break;
+    default: break;
+    }
+  }
+}
+
+static std::vector<std::pair<const char*, const char*>> splitLines(const char* begin, const char* end,
+								   const unsigned threads) {
+  // A few chunks per thread keep the pool busy when lines differ in cost
+  static const std::size_t minChunkSize = 64 * 1024;
+  const std::size_t chunkSize = std::max(minChunkSize, static_cast<std::size_t>(end - begin) / (threads * 4) + 1);
+
+  std::vector<std::pair<const char*, const char*>> chunks;
+  for (const char* pos = begin; pos != end;) {
+    const char* chunkEnd = end;
+
+    if (static_cast<std::size_t>(end - pos) > chunkSize) {
+      const void* eol = std::memchr(pos + chunkSize, '\n', end - pos - chunkSize);
+      chunkEnd = eol ? static_cast<const char*>(eol) + 1 : end;
+    }
+
+    chunks.emplace_back(pos, chunkEnd);
+    pos = chunkEnd;
+  }
+
+  return chunks;
+}
+
+void evaluateBatch(const char* begin, const char* end, const unsigned threads,
+		   std::ostream& out, std::ostream& err,
+		   const std::size_t cacheCapacity, const std::size_t cacheBytes, Statistics* stats) {
+  const auto chunks = splitLines(begin, end, std::max(threads, 1u));
+
+  std::vector<ChunkResult> results(chunks.size());
+  std::atomic<std::size_t> nextChunk(0);
+  std::mutex mutex;
+  std::condition_variable chunkReady;
+
+  auto worker = [&]() {
+    LineEvaluator evaluator(cacheCapacity, cacheBytes);
+    std::size_t i;
+
+    while ((i = nextChunk++) < chunks.size()) {
+      std::vector<OutputSegment> segments;
+
+      // Counted apart so that the threads do not fight over the totals
+      Statistics chunkStats;
+      evaluator.setStatistics(stats ? &chunkStats : nullptr);
+      evaluateChunk(chunks[i].first, chunks[i].second, evaluator, segments);
+
+      if (stats)
+	stats->merge(chunkStats);
+
+      std::lock_guard<std::mutex> lock(mutex);
+      results[i].segments = std::move(segments);
+      results[i].ready = true;
+      chunkReady.notify_all();
+    }
+  };
+
+  std::vector<std::thread> pool;
+  for (unsigned t = 0; t < std::max(threads, 1u); ++t)
+    pool.emplace_back(worker);
+
+  // Chunks are written out as soon as all the preceding ones are
+  for (auto& result : results) {
+    std::vector<OutputSegment> segments;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      chunkReady.wait(lock, [&result]() { return result.ready; });
+      segments = std::move(result.segments);
+    }
+
+    for (const auto& segment : segments) {
+      if (segment.error) {
+	out.flush();
+	err.write(segment.text.data(), segment.text.size());
+	err.flush();
+      }
+      else
+	out.write(segment.text.data(), segment.text.size());
+    }
+  }
+
+  out.flush();
+
+  for (auto& thread : pool)
+    thread.join();
+}
+
+void evaluateBatch(std::istream& in, const unsigned threads,
+		   std::ostream& out, std::ostream& err,
+		   const std::size_t cacheCapacity, const std::size_t cacheBytes, Statistics* stats) {
+  std::string input;
+  char buffer[64 * 1024];
+
+  {
+    PhaseTimer timer(stats, Statistics::ReadTime);
+    while (in.read(buffer, sizeof(buffer)) || in.gcount() > 0)
+      input.append(buffer, in.gcount());
+  }
+
+  if (stats)
+    stats->add(Statistics::BytesRead, input.size());
+
+  evaluateBatch(input.data(), input.data() + input.size(), threads, out, err, cacheCapacity, cacheBytes, stats);
+}
@@ -0,0 +1,38 @@
+#ifndef __BATCH_H__
+#define __BATCH_H__
+
+#include <cstddef>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "evaluator.h"
+#include "stats.h"
+
+// Consecutive lines going to the same stream, each with its '\n'
+struct OutputSegment {
+  bool error;
+  std::string text;
+};
+
+// Evaluates every line of the range and appends what calc would print
+void evaluateChunk(const char* pos, const char* end, LineEvaluator&, std::vector<OutputSegment>&);
+
+/* Evaluates every line of the range on a pool of worker threads. The
+   range is split into line-aligned chunks; results and error messages
+   are written in input order, with the output stream flushed before
+   each error so that the two streams interleave as in the serial
+   mode. Every worker gets a result cache of its own if asked for.
+   The statistics, if any, are updated after every chunk. */
+void evaluateBatch(const char* begin, const char* end, const unsigned threads,
+		   std::ostream& out, std::ostream& err,
+		   const std::size_t cacheCapacity = 0, const std::size_t cacheBytes = 0,
+		   Statistics* stats = nullptr);
+
+// Reads the whole stream before handing it over to the range version
+void evaluateBatch(std::istream& in, const unsigned threads,
+		   std::ostream& out, std::ostream& err,
+		   const std::size_t cacheCapacity = 0, const std::size_t cacheBytes = 0,
+		   Statistics* stats = nullptr);
+
+#endif
@@ -0,0 +1,662 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include "compact.h"
+#include "dag.h"
+#include "decimal.h"
+#include "evaluator.h"
+#include "format.h"
+#include "generator.h"
+#include "jit.h"
+#include "library.h"
+#include "optimizer.h"
+#include "output.h"
+#include "parallel.h"
+#include "parser.h"
+#include "pool.h"
+#include "prepared.h"
+#include "tree.h"
+
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+  unsigned seed = 2016;
+  std::size_t expressions = 20000;
+  std::size_t repeats = 11;
+  std::size_t rows = 1 << 20;
+  std::size_t maxNodes = 10000000;
+  std::string json;
+};
+
+// Timings of one stage along with the work done by each of its runs
+struct Stage {
+  std::string name;
+  std::size_t expressions;
+  std::size_t bytes;
+  std::size_t nodes;
+  std::vector<double> seconds;
+
+  // Nearest rank on the sorted timings
+  double percentile(const double p) const {
+    std::vector<double> sorted(seconds);
+    std::sort(sorted.begin(), sorted.end());
+
+    const std::size_t rank = static_cast<std::size_t>(p / 100 * (sorted.size() - 1) + 0.5);
+    return sorted[rank];
+  }
+};
+
+static double seconds(const Clock::time_point start) {
+  const std::chrono::duration<double> elapsed = Clock::now() - start;
+  return elapsed.count();
+}
+
+/* One warm-up run that is not counted, then the given number of them,
+   each one after an untimed setup */
+template <typename S, typename F>
+static Stage measure(const std::string& name, const std::size_t expressions, const std::size_t bytes,
+		     const std::size_t nodes, const std::size_t repeats, S setup, F run) {
+  Stage stage = { name, expressions, bytes, nodes, { } };
+  setup();
+  run();
+
+  for (std::size_t i = 0; i < repeats; ++i) {
+    setup();
+
+    const auto start = Clock::now();
+    run();
+    stage.seconds.push_back(seconds(start));
+  }
+
+  return stage;
+}
+
+template <typename F>
+static Stage measure(const std::string& name, const std::size_t expressions, const std::size_t bytes,
+		     const std::size_t nodes, const std::size_t repeats, F run) {
+  return measure(name, expressions, bytes, nodes, repeats, []() { }, run);
+}
+
+static void report(const Stage& stage) {
+  const double median = stage.percentile(50);
+
+  std::cout << std::left << std::setw(20) << stage.name << std::right
+	    << std::setw(10) << median * 1e3
+	    << std::setw(10) << stage.percentile(10) * 1e3
+	    << std::setw(10) << stage.percentile(90) * 1e3
+	    << std::setw(12) << stage.expressions / median / 1e6;
+
+  if (stage.bytes)
+    std::cout << std::setw(10) << stage.bytes / median / 1e6;
+  else
+    std::cout << std::setw(10) << "-";
+
+  if (stage.nodes)
+    std::cout << std::setw(10) << median * 1e9 / stage.nodes;
+  else
+    std::cout << std::setw(10) << "-";
+
+  std::cout << std::endl;
+}
+
+static void writeJson(std::ostream& out, const Options& options, const std::vector<Stage>& stages) {
+  out << std::setprecision(9);
+  out << "{\n  \"seed\": " << options.seed
+      << ",\n  \"expressions\": " << options.expressions
+      << ",\n  \"repeats\": " << options.repeats
+      << ",\n  \"stages\": [";
+
+  for (std::size_t i = 0; i < stages.size(); ++i) {
+    const Stage& stage = stages[i];
+    const double median = stage.percentile(50);
+
+    out << (i ? "," : "") << "\n    { \"name\": \"" << stage.name << "\""
+	<< ", \"expressions\": " << stage.expressions
+	<< ", \"bytes\": " << stage.bytes
+	<< ", \"nodes\": " << stage.nodes
+	<< ", \"median\": " << median
+	<< ", \"p10\": " << stage.percentile(10)
+	<< ", \"p90\": " << stage.percentile(90)
+	<< ", \"min\": " << stage.percentile(0)
+	<< ", \"max\": " << stage.percentile(100)
+	<< ", \"expressions_per_s\": " << stage.expressions / median
+	<< ", \"mb_per_s\": " << stage.bytes / median / 1e6
+	<< ", \"ns_per_node\": " << (stage.nodes ? median * 1e9 / stage.nodes : 0)
+	<< " }";
+  }
+
+  out << "\n  ]\n}\n";
+}
+
+struct Token {
+  char symbol; // '0' for numbers, '\n' for the end of an expression
+  double value;
+};
+
+/* The lexical half of the parser on its own: the same character
+   classes and the same number conversion, without building trees */
+static void tokenize(const std::string& input, std::vector<Token>& tokens) {
+  const char* cur = input.data();
+  const char* end = cur + input.size();
+  tokens.clear();
+
+  while (cur != end) {
+    const char c = *cur;
+
+    if ((c >= '0' && c <= '9') || ExpressionParser::isDecimalPoint(c)) {
+      const char* begin = cur;
+      while (cur != end && ((*cur >= '0' && *cur <= '9') || ExpressionParser::isDecimalPoint(*cur)))
+	++cur;
+
+      tokens.push_back({ '0', decimalToDouble(begin, cur) });
+    }
+    else {
+      if (c != ' ')
+	tokens.push_back({ c, 0 });
+      ++cur;
+    }
+  }
+}
+
+// Replays the tokens into trees, reusing the arena from one to another
+static double build(const std::vector<Token>& tokens, NodeArena& arena) {
+  double checksum = 0;
+  std::unique_ptr<EvaluationTree> tree;
+
+  for (const Token& token : tokens) {
+    if (!tree) {
+      arena.reset();
+      tree.reset(new EvaluationTree(arena));
+    }
+
+    switch (token.symbol) {
+    case '0': tree->insertOperand(token.value); break;
+    case '(': tree->openGroup(); break;
+    case ')': tree->closeGroup(); break;
+    case '\n':
+      checksum+= tree->getRoot()->filled();
+      tree.reset();
+      break;
+    default: tree->insertOperator(token.symbol);
+    }
+  }
+
+  return checksum;
+}
+
+// Writes nothing anywhere, for the end-to-end run
+class NullBuffer: public std::streambuf {
+protected:
+  int overflow(int c) override {
+    return c;
+  }
+
+  std::streamsize xsputn(const char*, std::streamsize n) override {
+    return n;
+  }
+};
+
+static void benchmarkStages(const Options& options, std::vector<Stage>& stages) {
+  std::srand(options.seed);
+
+  std::string input;
+  std::vector<double> expected;
+  for (std::size_t i = 0; i < options.expressions; ++i) {
+    auto expr = generateRandomExpression();
+    input+= expr->serialize() + "\n";
+    expected.push_back(expr->evaluate());
+  }
+
+  // Every number and operator is a node, and so is the root of each tree
+  std::vector<Token> tokens;
+  tokenize(input, tokens);
+  std::size_t nodes = 0;
+  for (const Token& token : tokens)
+    nodes+= token.symbol != '(' && token.symbol != ')';
+
+  const std::size_t count = options.expressions;
+  const std::size_t bytes = input.size();
+
+  std::cout << count << " random expressions, " << bytes << " bytes, " << nodes << " nodes, seed "
+	    << options.seed << ", " << options.repeats << " runs" << std::endl;
+  stages.push_back(measure("tokenize", count, bytes, nodes, options.repeats, [&]() {
+	tokenize(input, tokens);
+      }));
+
+  NodeArena arena;
+  stages.push_back(measure("build", count, bytes, nodes, options.repeats, [&]() {
+	if (build(tokens, arena) != count)
+	  std::cerr << "wrong number of trees" << std::endl;
+      }));
+
+  stages.push_back(measure("parse", count, bytes, nodes, options.repeats, [&]() {
+	for (const char* pos = input.data(); pos != input.data() + input.size(); ) {
+	  arena.reset();
+	  pos = ExpressionParser::parseBuffer(pos, input.data() + input.size(), arena).getPosition();
+	}
+      }));
+
+  // The trees stay alive for evaluation, which is cached after the first run
+  NodeArena treeArena;
+  std::vector<EvaluationTree> trees;
+  std::vector<std::vector<Leaf*>> leaves;
+  auto parseAll = [&]() {
+    treeArena.reset();
+    trees.clear();
+    leaves.clear();
+
+    for (const char* pos = input.data(); pos != input.data() + input.size(); ) {
+      auto parser = ExpressionParser::parseBuffer(pos, input.data() + input.size(), treeArena);
+      pos = parser.getPosition();
+      trees.push_back(std::move(parser.getTree()));
+      leaves.push_back(trees.back().getLeaves());
+    }
+  };
+
+  std::vector<double> results(count);
+  auto evaluateAll = [&]() {
+    for (std::size_t i = 0; i < count; ++i)
+      results[i] = trees[i].evaluate();
+  };
+
+  stages.push_back(measure("evaluate", count, 0, nodes, options.repeats, parseAll, evaluateAll));
+
+  // One operand of every expression changes between the runs
+  std::size_t update = 0;
+  stages.push_back(measure("evaluate/update", count, 0, 0, options.repeats, [&]() {
+	++update;
+	for (auto& operands : leaves)
+	  operands[update % operands.size()]->setValue(update % 100);
+      }, evaluateAll));
+
+  stages.push_back(measure("evaluate/cached", count, 0, 0, options.repeats, evaluateAll));
+
+  // Back to the original operands for checking
+  parseAll();
+  evaluateAll();
+
+  for (std::size_t i = 0; i < count; ++i)
+    if (std::abs(results[i] - expected[i]) > 0.01)
+      std::cerr << "wrong result for expression " << i << std::endl;
+
+  char buffer[formatBufferSize];
+  std::size_t formatted = 0;
+  for (const double result : results)
+    formatted+= formatDouble(result, buffer) + 1;
+
+  stages.push_back(measure("format", count, formatted, 0, options.repeats, [&]() {
+	for (const double result : results)
+	  formatDouble(result, buffer);
+      }));
+
+  // What calc does with its input, output going nowhere
+  NullBuffer nullBuffer;
+  std::ostream null(&nullBuffer);
+  stages.push_back(measure("calc", count, bytes, nodes, options.repeats, [&]() {
+	LineEvaluator evaluator;
+	OutputBuffer output(null);
+	std::string text;
+
+	for (const char* pos = input.data(); pos != input.data() + input.size(); )
+	  if (evaluator.evaluateLine(pos, input.data() + input.size(), text) == LineEvaluator::Outcome::Result)
+	    output.writeLine(text.data(), text.size());
+      }));
+}
+
+static void benchmarkColumns(const Options& options, std::vector<Stage>& stages) {
+  static const std::string formula = "(x*y - 2,5*z)/(x + 1) + -(y - z)*(z - x)*0,5";
+  auto expr = PreparedExpression::prepare(formula);
+  const std::size_t rows = options.rows;
+
+  std::srand(options.seed);
+  std::vector<std::vector<double>> columns(expr.getVariableCount(), std::vector<double>(rows));
+  std::vector<const double*> columnPtrs;
+  for (auto& column : columns) {
+    for (auto& value : column)
+      value = static_cast<double>(std::rand() % 20001 - 10000) / 100.0;
+    columnPtrs.push_back(column.data());
+  }
+
+  std::vector<double> results(rows);
+  std::vector<double> row(columns.size());
+
+  // Rows are the expressions here, and instructions are the nodes
+  const std::size_t bytes = rows * columns.size() * sizeof(double);
+  const std::size_t nodes = rows * expr.getProgram().getCode().size();
+  std::cout << std::endl << "Columnar evaluation of " << formula << ", " << rows << " rows" << std::endl;
+
+  stages.push_back(measure("columns/row", rows, bytes, nodes, options.repeats, [&]() {
+	for (std::size_t i = 0; i < rows; ++i) {
+	  for (std::size_t k = 0; k < columns.size(); ++k)
+	    row[k] = columns[k][i];
+	  results[i] = expr.getProgram().evaluate(row.data());
+	}
+      }));
+
+  const JitFunction native = JitFunction::compile(expr.getProgram());
+  if (native.getFunction())
+    stages.push_back(measure("columns/jit", rows, bytes, nodes, options.repeats, [&]() {
+	  for (std::size_t i = 0; i < rows; ++i) {
+	    for (std::size_t k = 0; k < columns.size(); ++k)
+	      row[k] = columns[k][i];
+	    results[i] = native.getFunction()(row.data());
+	  }
+	}));
+
+  for (const auto kernels : supportedColumnKernels())
+    for (const std::size_t blockSize : { 16, 64, 256, 1024, 4096 })
+      stages.push_back(measure(std::string("columns/") + kernels->name + "/" + std::to_string(blockSize),
+			       rows, bytes, nodes, options.repeats, [&]() {
+	    expr.evaluateColumns(columnPtrs.data(), rows, results.data(), *kernels, blockSize);
+	  }));
+}
+
+/* Startup with the expressions prepared from text against mapping a
+   library of them, with and without the checks */
+static void benchmarkLibrary(const Options& options, std::vector<Stage>& stages) {
+  std::srand(options.seed);
+
+  std::string input;
+  for (std::size_t i = 0; i < options.expressions; ++i)
+    input+= generateRandomExpression()->serialize() + "\n";
+
+  const std::size_t count = options.expressions;
+  const std::string path = "/tmp/calc-bench-" + std::to_string(getpid()) + ".lib";
+  std::vector<PreparedExpression> prepared;
+
+  stages.push_back(measure("library/prepare", count, input.size(), 0, options.repeats, [&]() {
+	prepared.clear();
+	for (const char* pos = input.data(); pos != input.data() + input.size(); ) {
+	  const char* eol = static_cast<const char*>(std::memchr(pos, '\n', input.data() + input.size() - pos));
+	  prepared.push_back(PreparedExpression::prepare(pos, eol));
+	  pos = eol + 1;
+	}
+      }));
+
+  stages.push_back(measure("library/save", count, 0, 0, options.repeats, [&]() {
+	LibraryWriter writer;
+	for (const auto& expression : prepared)
+	  writer.add(expression);
+	writer.save(path);
+      }));
+
+  std::ifstream file(path, std::ios::binary | std::ios::ate);
+  const std::size_t bytes = file.tellg();
+  std::cout << std::endl << "Library of " << count << " expressions, " << bytes << " bytes" << std::endl;
+
+  stages.push_back(measure("library/open", count, bytes, 0, options.repeats, [&]() {
+	ExpressionLibrary::open(path);
+      }));
+
+  stages.push_back(measure("library/open/trusted", count, bytes, 0, options.repeats, [&]() {
+	ExpressionLibrary::open(path, false);
+      }));
+
+  const ExpressionLibrary library = ExpressionLibrary::open(path);
+  std::vector<double> results(count);
+  stages.push_back(measure("library/evaluate", count, 0, 0, options.repeats, [&]() {
+	for (std::size_t i = 0; i < count; ++i)
+	  results[i] = library.evaluate(i);
+      }));
+
+  for (std::size_t i = 0; i < count; ++i) {
+    const double expected = prepared[i].evaluate();
+    if (std::memcmp(&results[i], &expected, sizeof(double)))
+      std::cerr << "wrong result for library expression " << i << std::endl;
+  }
+
+  unlink(path.c_str());
+}
+
+/* A formula made of a few blocks copied over and over, evaluated as a
+   compiled tree and with the copies merged */
+static void benchmarkSharing(const Options& options, std::vector<Stage>& stages) {
+  static const char operators[] = "+-*/";
+  std::srand(options.seed);
+
+  std::vector<std::string> blocks;
+  for (int i = 0; i < 8; ++i)
+    blocks.push_back(generateRandomExpression()->serialize());
+
+  std::string formula = blocks[0];
+  for (int i = 1; i < 200; ++i) {
+    formula.push_back(operators[std::rand() % 4]);
+    formula+= blocks[std::rand() % blocks.size()];
+  }
+
+  auto parser = ExpressionParser::parseBuffer(formula.data(), formula.data() + formula.size());
+  const CompiledExpression program = CompiledExpression::compile(parser.getTree());
+  const ExpressionDag dag = ExpressionDag::build(parser.getTree());
+
+  const std::size_t runs = options.expressions;
+  const std::size_t nodes = runs * dag.getTreeNodeCount();
+  double compiledResult = 0, dagResult = 0;
+
+  std::cout << std::endl << "Shared subexpressions: " << dag.getTreeNodeCount() << " tree nodes merged into "
+	    << dag.getNodeCount() << ", ratio " << dag.getDeduplicationRatio() << ", "
+	    << dag.getBytesSaved() << " bytes saved" << std::endl;
+
+  stages.push_back(measure("shared/compiled", runs, 0, nodes, options.repeats, [&]() {
+	for (std::size_t i = 0; i < runs; ++i)
+	  compiledResult = program.evaluate();
+      }));
+
+  stages.push_back(measure("shared/dag", runs, 0, nodes, options.repeats, [&]() {
+	for (std::size_t i = 0; i < runs; ++i)
+	  dagResult = dag.evaluate();
+      }));
+
+  if (std::memcmp(&compiledResult, &dagResult, sizeof(double)))
+    std::cerr << "wrong result for the shared formula" << std::endl;
+}
+
+/* One long expression as linked nodes and as the compact arrays, both
+   parsed from the text. The leaves of the linked tree are touched
+   before every run, so that it gets evaluated in full. */
+static void benchmarkCompact(const Options& options, std::vector<Stage>& stages) {
+  static const char operators[] = "+-*/";
+  std::srand(options.seed);
+
+  std::string formula = generateRandomExpression()->serialize();
+  for (std::size_t i = 1; i < options.expressions; ++i) {
+    formula.push_back(operators[std::rand() % 4]);
+    formula+= generateRandomExpression()->serialize();
+  }
+
+  const char* begin = formula.data();
+  const char* end = begin + formula.size();
+
+  NodeArena arena;
+  auto parser = ExpressionParser::parseBuffer(begin, end, arena);
+  const std::size_t linkedNodes = arena.getObjectsCreated();
+  const std::size_t linkedBytes = arena.getBytesReserved();
+
+  const char* pos = begin;
+  const CompactTree compact = CompactTree::parse(pos, end);
+  const std::size_t compactNodes = compact.getNodeCount();
+
+  std::cout << std::endl << "Linked tree: " << linkedNodes << " nodes, " << static_cast<double>(linkedBytes) / linkedNodes
+	    << " bytes a node; compact: " << compactNodes << " nodes, "
+	    << static_cast<double>(compact.getBytes()) / compactNodes << " bytes a node" << std::endl;
+
+  stages.push_back(measure("linked/build", 1, formula.size(), linkedNodes, options.repeats, [&]() {
+	NodeArena buildArena;
+	ExpressionParser::parseBuffer(begin, end, buildArena);
+      }));
+
+  stages.push_back(measure("compact/build", 1, formula.size(), compactNodes, options.repeats, [&]() {
+	const char* cur = begin;
+	CompactTree::parse(cur, end);
+      }));
+
+  const std::vector<Leaf*> leaves = parser.getTree().getLeaves();
+  double linkedResult = 0, compactResult = 0;
+
+  stages.push_back(measure("linked/evaluate", 1, 0, linkedNodes, options.repeats, [&]() {
+	for (Leaf* leaf : leaves)
+	  leaf->setValue(leaf->getValue());
+      }, [&]() {
+	linkedResult = parser.getTree().evaluate();
+      }));
+
+  stages.push_back(measure("compact/evaluate", 1, 0, compactNodes, options.repeats, [&]() {
+	compactResult = compact.evaluate();
+      }));
+
+  if (std::memcmp(&linkedResult, &compactResult, sizeof(double)))
+    std::cerr << "wrong result for the compact tree" << std::endl;
+}
+
+/* A sum of a million terms regrouped into a balanced tree, evaluated
+   on one thread and on a work-stealing pool. The leaves are touched
+   before every run, so that the whole tree gets evaluated anew. */
+static void benchmarkParallel(const Options& options, std::vector<Stage>& stages) {
+  static const std::size_t terms = 1000000;
+  const std::size_t nodes = 2 * terms - 1;
+  std::srand(options.seed);
+
+  EvaluationTree tree;
+  tree.insertOperand(std::rand() % 1000 / 100.0);
+  for (std::size_t term = 1; term < terms; ++term) {
+    tree.insertOperator('+');
+    tree.insertOperand(std::rand() % 1000 / 100.0);
+  }
+  balanceChains(tree);
+
+  const std::vector<Leaf*> leaves = tree.getLeaves();
+  auto touch = [&]() {
+    for (Leaf* leaf : leaves)
+      leaf->setValue(leaf->getValue());
+  };
+
+  const std::size_t threads = std::max(2u, std::thread::hardware_concurrency());
+  WorkStealingPool pool(threads);
+  ParallelEvaluation parallel(tree);
+  double serialResult = 0, parallelResult = 0;
+
+  std::cout << std::endl << "Balanced sum of " << terms << " terms in " << parallel.getTaskCount() + 1
+	    << " tasks on " << threads << " threads" << std::endl;
+
+  stages.push_back(measure("parallel/serial", 1, 0, nodes, options.repeats, touch, [&]() {
+	serialResult = tree.evaluate();
+      }));
+
+  stages.push_back(measure("parallel/" + std::to_string(threads), 1, 0, nodes, options.repeats, touch, [&]() {
+	parallelResult = parallel.evaluate(pool);
+      }));
+
+  if (std::memcmp(&serialResult, &parallelResult, sizeof(double)))
+    std::cerr << "wrong result for the parallel sum" << std::endl;
+}
+
+/* Left-deep chains of additions as insertOperator builds them from
+   1+1+...+1, timed while being built, evaluated and torn down */
+static void benchmarkTrees(const Options& options, std::vector<Stage>& stages) {
+  std::cout << std::endl << "Trees of up to " << options.maxNodes << " nodes" << std::endl;
+
+  for (std::size_t nodes = 1000000; nodes <= options.maxNodes; nodes*= 10) {
+    const std::size_t terms = (nodes + 1) / 2;
+    const std::string size = std::to_string(nodes);
+
+    Stage building = { "tree/build/" + size, 1, 0, nodes, { } };
+    Stage evaluation = { "tree/evaluate/" + size, 1, 0, nodes, { } };
+    Stage teardown = { "tree/free/" + size, 1, 0, nodes, { } };
+
+    // Only one tree at a time fits in memory at the largest sizes
+    const std::size_t repeats = std::max<std::size_t>(1, options.repeats * 1000000 / nodes);
+    for (std::size_t i = 0; i < repeats; ++i) {
+      auto start = Clock::now();
+
+      std::unique_ptr<EvaluationTree> tree(new EvaluationTree());
+      tree->insertOperand(1);
+      for (std::size_t term = 1; term < terms; ++term) {
+	tree->insertOperator('+');
+	tree->insertOperand(1);
+      }
+      building.seconds.push_back(seconds(start));
+
+      start = Clock::now();
+      if (tree->evaluate() != terms)
+	std::cerr << "wrong result" << std::endl;
+      evaluation.seconds.push_back(seconds(start));
+
+      start = Clock::now();
+      tree.reset();
+      teardown.seconds.push_back(seconds(start));
+    }
+
+    stages.push_back(building);
+    stages.push_back(evaluation);
+    stages.push_back(teardown);
+  }
+}
+
+static bool parseOptions(int argc, char** argv, Options& options) {
+  for (int i = 1; i + 1 < argc; i+= 2) {
+    const char* value = argv[i + 1];
+
+    if (!std::strcmp(argv[i], "--seed"))
+      options.seed = std::strtoul(value, nullptr, 10);
+    else if (!std::strcmp(argv[i], "--expressions"))
+      options.expressions = std::strtoull(value, nullptr, 10);
+    else if (!std::strcmp(argv[i], "--repeats"))
+      options.repeats = std::strtoull(value, nullptr, 10);
+    else if (!std::strcmp(argv[i], "--rows"))
+      options.rows = std::strtoull(value, nullptr, 10);
+    else if (!std::strcmp(argv[i], "--max-nodes"))
+      options.maxNodes = std::strtoull(value, nullptr, 10);
+    else if (!std::strcmp(argv[i], "--json"))
+      options.json = value;
+    else
+      return false;
+  }
+
+  return argc % 2 && options.repeats > 0 && options.expressions > 0;
+}
+
+int main(int argc, char** argv) {
+  Options options;
+
+  if (!parseOptions(argc, argv, options)) {
+    std::cerr << "usage: bench [--seed N] [--expressions N] [--repeats N] [--rows N] [--max-nodes N] [--json FILE]" << std::endl;
+    return 1;
+  }
+
+  std::vector<Stage> stages;
+  std::cout << std::fixed << std::setprecision(2);
+
+  benchmarkStages(options, stages);
+  benchmarkColumns(options, stages);
+  benchmarkSharing(options, stages);
+  benchmarkLibrary(options, stages);
+  benchmarkCompact(options, stages);
+  benchmarkParallel(options, stages);
+  benchmarkTrees(options, stages);
+
+  std::cout << std::endl << std::left << std::setw(20) << "stage" << std::right << std::setw(10) << "median ms"
+	    << std::setw(10) << "p10 ms" << std::setw(10) << "p90 ms" << std::setw(12) << "Mexpr/s"
+	    << std::setw(10) << "MB/s" << std::setw(10) << "ns/node" << std::endl;
+
+  for (const auto& stage : stages)
+    report(stage);
+
+  if (!options.json.empty()) {
+    std::ofstream out(options.json);
+    writeJson(out, options, stages);
+  }
+
+  return 0;
+}
@@ -0,0 +1,191 @@
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+
+#include "bytecode.h"
+
+static OpCode binaryOpCode(const Operator& op) {
+  switch (op.getSymbol()) {
+  case '+': return OpCode::Add;
+  case '-': return OpCode::Subtract;
+  case '*': return OpCode::Multiply;
+  case '/': return OpCode::Divide;
+  default: throw std::runtime_error("Unknown binary operator");
+  }
+}
+
+double evaluateProgram(const OpCode* code, const OpCode* codeEnd,
+		       const OperandType* constants, const std::uint32_t* slots,
+		       const OperandType* variables, OperandType* stack) {
+  OperandType* top = stack;
+
+  for (; code != codeEnd; ++code) {
+    switch (*code) {
+    case OpCode::Push: *top++ = *constants++; break;
+    case OpCode::Load: *top++ = variables[*slots++]; break;
+    case OpCode::Negate: top[-1] = -top[-1]; break;
+    case OpCode::Add: --top; top[-1] = top[-1] + top[0]; break;
+    case OpCode::Subtract: --top; top[-1] = top[-1] - top[0]; break;
+    case OpCode::Multiply: --top; top[-1] = top[-1] * top[0]; break;
+    case OpCode::Divide: --top; top[-1] = top[-1] / top[0]; break;
+    }
+  }
+
+  return stack[0];
+}
+
+CompiledExpression CompiledExpression::compile(const EvaluationTree& tree) {
+  CompiledExpression result;
+  std::size_t depth = 0;
+
+  auto emit = [&result, &depth](const OpCode op, const int stackEffect) {
+    result.code_.push_back(op);
+    depth+= stackEffect;
+    if (depth > result.stackDepth_)
+      result.stackDepth_ = depth;
+  };
+
+  const TreeNode* first = static_cast<const RootNode*>(tree.getRoot())->getChild();
+  if (!first)
+    throw std::runtime_error("Compiling an empty tree");
+
+  /* Post-order walk with an explicit stack: the flag tells whether the
+     node's children have already been emitted. */
+  std::vector<std::pair<const TreeNode*, bool>> pending;
+  pending.emplace_back(first, false);
+
+  while (!pending.empty()) {
+    const TreeNode* node = pending.back().first;
+    const bool childrenDone = pending.back().second;
+    pending.pop_back();
+
+    switch (node->getKind()) {
+    case NodeKind::Leaf:
+      result.constants_.push_back(static_cast<const Leaf*>(node)->getValue());
+      emit(OpCode::Push, 1);
+      break;
+
+    case NodeKind::Variable:
+      result.slots_.push_back(static_cast<const Variable*>(node)->getIndex());
+      emit(OpCode::Load, 1);
+      break;
+
+    case NodeKind::Unary: {
+      const UnaryNode* unary = static_cast<const UnaryNode*>(node);
+
+      if (!childrenDone) {
+	if (!unary->filled())
+	  throw std::runtime_error("Compiling unary node without an operand");
+
+	pending.emplace_back(node, true);
+	pending.emplace_back(unary->getChild(), false);
+      }
+      else if (unary->getOperator().getSymbol() == '-')
+	emit(OpCode::Negate, 0);
+      else if (unary->getOperator().getSymbol() != '+') // Unary plus is a no-op
+	throw std::runtime_error("Unknown unary operator");
+      break;
+    }
+
+    case NodeKind::Binary: {
+      const BinaryNode* binary = static_cast<const BinaryNode*>(node);
+
+      if (!childrenDone) {
+	if (!binary->filled())
+	  throw std::runtime_error("Compiling binary node without operand(s)");
+
+	pending.emplace_back(node, true);
+	pending.emplace_back(binary->getRightChild(), false);
+	pending.emplace_back(binary->getLeftChild(), false);
+      }
+      else
+	emit(binaryOpCode(binary->getOperator()), -1);
+      break;
+    }
+
+    default:
+      throw std::runtime_error("Unexpected node in expression");
+    }
+  }
+
+  return result;
+}
+
+double CompiledExpression::evaluate(const OperandType* variables) const {
+  // Small programs don't need to touch the heap
+  static const std::size_t localDepth = 64;
+
+  if (stackDepth_ <= localDepth) {
+    OperandType stack[localDepth];
+    return evaluateProgram(code_.data(), code_.data() + code_.size(), constants_.data(), slots_.data(), variables, stack);
+  }
+
+  std::vector<OperandType> stack(stackDepth_);
+  return evaluateProgram(code_.data(), code_.data() + code_.size(), constants_.data(), slots_.data(), variables, stack.data());
+}
+
+void CompiledExpression::evaluateColumns(const OperandType* const* columns, const std::size_t rows,
+					 OperandType* results, const ColumnKernels& kernels,
+					 const std::size_t blockSize) const {
+  if (!blockSize)
+    throw std::invalid_argument("Evaluating columns in empty blocks");
+
+  /* Stack entries point either to an input column or to the block
+     owned by their slot; slot zero computes straight into the results */
+  std::vector<OperandType> blocks((stackDepth_ - 1) * blockSize);
+  std::vector<OperandType*> slotBlocks(stackDepth_);
+  std::vector<const OperandType*> stack(stackDepth_);
+
+  for (std::size_t k = 1; k < stackDepth_; ++k)
+    slotBlocks[k] = blocks.data() + (k - 1) * blockSize;
+
+  for (std::size_t offset = 0; offset < rows; offset+= blockSize) {
+    const std::size_t n = std::min(blockSize, rows - offset);
+    const OperandType* constant = constants_.data();
+    const std::uint32_t* slot = slots_.data();
+    std::size_t top = 0;
+
+    slotBlocks[0] = results + offset;
+
+    for (const OpCode op : code_) {
+      switch (op) {
+      case OpCode::Push:
+	std::fill_n(slotBlocks[top], n, *constant++);
+	stack[top] = slotBlocks[top];
+	++top;
+	break;
+      case OpCode::Load:
+	stack[top++] = columns[*slot++] + offset;
+	break;
+      case OpCode::Negate:
+	kernels.negate(stack[top - 1], slotBlocks[top - 1], n);
+	stack[top - 1] = slotBlocks[top - 1];
+	break;
+      case OpCode::Add:
+	--top;
+	kernels.add(stack[top - 1], stack[top], slotBlocks[top - 1], n);
+	stack[top - 1] = slotBlocks[top - 1];
+	break;
+      case OpCode::Subtract:
+	--top;
+	kernels.subtract(stack[top - 1], stack[top], slotBlocks[top - 1], n);
+	stack[top - 1] = slotBlocks[top - 1];
+	break;
+      case OpCode::Multiply:
+	--top;
+	kernels.multiply(stack[top - 1], stack[top], slotBlocks[top - 1], n);
+	stack[top - 1] = slotBlocks[top - 1];
+	break;
+      case OpCode::Divide:
+	--top;
+	kernels.divide(stack[top - 1], stack[top], slotBlocks[top - 1], n);
+	stack[top - 1] = slotBlocks[top - 1];
+	break;
+      }
+    }
+
+    // A lone variable is still sitting in its column
+    if (stack[0] != results + offset)
+      std::copy_n(stack[0], n, results + offset);
+  }
+}
@@ -0,0 +1,69 @@
+#ifndef __BYTECODE_H__
+#define __BYTECODE_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "simd.h"
+#include "tree.h"
+
+enum class OpCode: unsigned char {
+  Push,     // next value from the constant pool
+  Load,     // variable numbered by the next slot
+  Negate,
+  Add,
+  Subtract,
+  Multiply,
+  Divide
+};
+
+/* Runs a postfix program. Push and Load instructions consume the
+   constant pool and the variable slots in order, so instructions carry
+   no operands. The stack must hold at least as many values as the
+   program's maximal depth. */
+double evaluateProgram(const OpCode* code, const OpCode* codeEnd,
+		       const OperandType* constants, const std::uint32_t* slots,
+		       const OperandType* variables, OperandType* stack);
+
+class CompiledExpression {
+public:
+  static CompiledExpression compile(const EvaluationTree&);
+
+  // Variables are looked up by index in the given array
+  double evaluate(const OperandType* variables = nullptr) const;
+
+  /* Evaluates a column-major table a block of rows at a time: every
+     instruction is applied to the whole block with the given kernels.
+     Row i binds variable k to columns[k][i]; the results must not
+     alias the columns. A zero block size is an invalid_argument. */
+  void evaluateColumns(const OperandType* const* columns, const std::size_t rows, OperandType* results,
+		       const ColumnKernels&, const std::size_t blockSize) const;
+
+  const std::vector<OpCode>& getCode() const {
+    return code_;
+  }
+
+  const std::vector<OperandType>& getConstants() const {
+    return constants_;
+  }
+
+  const std::vector<std::uint32_t>& getSlots() const {
+    return slots_;
+  }
+
+  std::size_t getStackDepth() const {
+    return stackDepth_;
+  }
+
+private:
+  CompiledExpression() = default;
+
+  std::vector<OpCode> code_;
+  std::vector<OperandType> constants_;
+  std::vector<std::uint32_t> slots_;
+
+  std::size_t stackDepth_ = 0;
+};
+
+#endif
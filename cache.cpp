@@ -0,0 +1,76 @@
+#include <cctype>
+
+#include "cache.h"
+
+static bool isSpace(const char c) {
+  return std::isspace(static_cast<unsigned char>(c));
+}
+
+// Characters of numbers and identifiers
+static bool isWordChar(const char c) {
+  return std::isalnum(static_cast<unsigned char>(c)) || c == '_' || c == '.' || c == ',';
+}
+
+void ResultCache::normalize(const char* begin, const char* end, std::string& key) {
+  bool spaceSkipped = false;
+  key.clear();
+
+  for (const char* pos = begin; pos != end; ++pos) {
+    if (isSpace(*pos)) {
+      spaceSkipped = !key.empty();
+      continue;
+    }
+
+    if (spaceSkipped && isWordChar(key.back()) && isWordChar(*pos))
+      key.push_back(' ');
+
+    spaceSkipped = false;
+    key.push_back(*pos);
+  }
+}
+
+bool ResultCache::find(const std::string& key, double& value) {
+  auto it = index_.find(key);
+
+  if (it == index_.end()) {
+    ++misses_;
+    return false;
+  }
+
+  ++hits_;
+  entries_.splice(entries_.begin(), entries_, it->second);
+  value = it->second->second;
+
+  return true;
+}
+
+void ResultCache::insert(const std::string& key, const double value) {
+  auto it = index_.find(key);
+
+  if (it != index_.end()) {
+    it->second->second = value;
+    entries_.splice(entries_.begin(), entries_, it->second);
+    return;
+  }
+
+  const std::size_t newBytes = entryBytes(key);
+  if (maxBytes_ && newBytes > maxBytes_)
+    return; // Would not fit even alone
+
+  entries_.emplace_front(key, value);
+  index_.emplace(key, entries_.begin());
+  bytes_+= newBytes;
+
+  while ((capacity_ && index_.size() > capacity_) || (maxBytes_ && bytes_ > maxBytes_))
+    evict();
+}
+
+void ResultCache::evict() {
+  const Entry& last = entries_.back();
+
+  bytes_-= entryBytes(last.first);
+  index_.erase(last.first);
+  entries_.pop_back();
+
+  ++evictions_;
+}
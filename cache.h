@@ -0,0 +1,71 @@
+#ifndef __CACHE_H__
+#define __CACHE_H__
+
+#include <cstddef>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+/* Bounded LRU map from expression text to its value. Keys have their
+   whitespace normalized, so lines differing only in spacing share an
+   entry. Both the number of entries and their estimated memory
+   footprint are limited; zero means no limit. */
+class ResultCache {
+public:
+  ResultCache(const std::size_t capacity, const std::size_t maxBytes = 0):
+    capacity_(capacity), maxBytes_(maxBytes) { }
+
+  /* Drops all whitespace but a single space between two number or
+     identifier characters: only there it separates tokens, so the key
+     evaluates just like the original text. */
+  static void normalize(const char* begin, const char* end, std::string& key);
+
+  // Marks the entry as the most recently used one
+  bool find(const std::string& key, double& value);
+  void insert(const std::string& key, const double value);
+
+  std::size_t size() const {
+    return index_.size();
+  }
+
+  std::size_t getBytes() const {
+    return bytes_;
+  }
+
+  std::size_t getHits() const {
+    return hits_;
+  }
+
+  std::size_t getMisses() const {
+    return misses_;
+  }
+
+  std::size_t getEvictions() const {
+    return evictions_;
+  }
+
+private:
+  using Entry = std::pair<std::string, double>;
+  using EntryList = std::list<Entry>;
+
+  // The key is stored both in the list and in the index
+  static std::size_t entryBytes(const std::string& key) {
+    return 2 * (sizeof(std::string) + key.size()) + sizeof(Entry) + 4 * sizeof(void*);
+  }
+
+  void evict();
+
+  std::size_t capacity_;
+  std::size_t maxBytes_;
+
+  EntryList entries_; // Most recently used first
+  std::unordered_map<std::string, EntryList::iterator> index_;
+
+  std::size_t bytes_ = 0;
+  std::size_t hits_ = 0;
+  std::size_t misses_ = 0;
+  std::size_t evictions_ = 0;
+};
+
+#endif
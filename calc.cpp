@@ -1,47 +1,236 @@
-#include <iomanip>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
-#include <limits>
-#include <sstream>
+#include <system_error>
+#include <string>
+#include <thread>
 
-#include "exceptions.h"
+#include <signal.h>
+#include <unistd.h>
+
+#include "batch.h"
+#include "evaluator.h"
+#include "output.h"
 #include "parser.h"
+#include "pipeline.h"
+#include "server.h"
+#include "stats.h"
+#include "streaming.h"
 
-static std::string formatDouble(const double val) {
-  std::ostringstream stream;
-  stream << std::setprecision(2) 
-	 << std::fixed 
-	 << val;
+static void usage() {
+  std::cerr << "использование: calc [--threads N | --pipeline N | --file ПУТЬ | --socket ПУТЬ [--max-connections N]] [--cache N] [--cache-bytes N] [--stats]" << std::endl;
+}
 
-  std::string result = stream.str();
-  static const char decPoint = std::use_facet<std::numpunct<char>>(stream.getloc()).decimal_point();
+static bool parseCount(const char* arg, std::size_t& result) {
+  char* end;
+  const long long n = std::strtoll(arg, &end, 10);
 
-  // Remove trailing zeros
-  auto rIt = result.rbegin();
-  while (*rIt == '0') ++rIt;
+  if (*end || end == arg || n < 0)
+    return false;
 
-  if (*rIt == decPoint) // for integers
-    ++rIt;
+  result = n;
+  return true;
+}
 
-  result.erase(rIt.base(), result.end());
+// Bypasses the streams, which may be busy in another thread
+static void printSummary(const std::string& summary) {
+  for (std::size_t done = 0; done < summary.size(); ) {
+    const ssize_t written = write(STDERR_FILENO, summary.data() + done, summary.size() - done);
+    if (written <= 0)
+      return;
 
-  return result;
+    done+= written;
+  }
 }
 
-int main() {
-  while (std::cin.good()) {
-    try {
-      auto parser = ExpressionParser::parseStream(std::cin);
+static void printStatistics(const Statistics& stats) {
+  printSummary(stats.summary());
+}
+
+/* SIGUSR1 is blocked in every thread, this one waits for it and
+   prints the statistics gathered so far */
+static void reportOnSignal(const Statistics& stats) {
+  sigset_t signals;
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGUSR1);
+  pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+  std::thread([&stats, signals]() {
+      int signal;
+      while (!sigwait(&signals, &signal))
+	printStatistics(stats);
+    }).detach();
+}
+
+static CalcServer* runningServer = nullptr;
+
+static void stopServer(int) {
+  runningServer->stop();
+}
+
+// Serves until SIGINT or SIGTERM
+static int serve(const std::string& path, const CalcServer::Limits& limits,
+		 const std::size_t cacheCapacity, const std::size_t cacheBytes, Statistics* stats) {
+  try {
+    CalcServer server(path, limits, cacheCapacity, cacheBytes);
+    server.setStatistics(stats);
+    runningServer = &server;
+
+    struct sigaction action;
+    std::memset(&action, 0, sizeof(action));
+    action.sa_handler = stopServer;
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
 
-      if (!parser.nothingRead())
-	std::cout << formatDouble(parser.getTree().evaluate()) << std::endl;
+    server.run();
+
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+    runningServer = nullptr;
+  }
+  catch (std::system_error& e) {
+    std::cerr << "ошибка сервера: " << e.what() << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
+
+// The file is read in place, each expression in a single pass
+static int evaluateFile(const std::string& path, Statistics* stats) {
+  try {
+    const MappedFile file(path);
+    evaluateStreaming(file.begin(), file.end(), std::cout, std::cerr, stats);
+  }
+  catch (std::system_error& e) {
+    std::cerr << "ошибка чтения файла: " << e.what() << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
+
+/* Results are flushed whenever reading on could block, so that a
+   pipe gets them a batch at a time while a terminal sees each one
+   as soon as it is ready. */
+static void evaluateLines(LineEvaluator& evaluator, Statistics* stats) {
+  const bool interactive = isatty(STDIN_FILENO) || isatty(STDOUT_FILENO);
+  OutputBuffer output(std::cout);
+  std::string line;
+  std::string text;
+
+  for (;;) {
+    if (std::cin.rdbuf()->in_avail() <= 0)
+      output.flush();
+
+    {
+      PhaseTimer timer(stats, Statistics::ReadTime);
+      if (!ExpressionParser::readLine(std::cin, line))
+	break;
     }
-    catch (Exceptions::ParsingException& e) {
-      std::cerr << e.what() << std::endl;
 
-      // Prepare ourselves for the next expression
-      std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+    if (stats)
+      stats->add(Statistics::BytesRead, line.size());
+
+    const char* pos = line.data();
+
+    switch (evaluator.evaluateLine(pos, line.data() + line.size(), text)) {
+    case LineEvaluator::Outcome::Result:
+      output.writeLine(text.data(), text.size());
+      if (interactive)
+	output.flush();
+      break;
+    case LineEvaluator::Outcome::Error:
+      // Keeps the order in which results and errors interleave
+      output.flush();
+      std::cerr << text << std::endl;
+      break;
+    default: break;
     }
   }
+}
 
-  return 0;
+int main(int argc, char** argv) {
+  std::ios::sync_with_stdio(false);
+
+  std::size_t threads = 0;
+  std::size_t evaluators = 0;
+  std::size_t cacheCapacity = 0;
+  std::size_t cacheBytes = 0;
+  bool statsMode = false;
+  std::string socketPath;
+  std::string filePath;
+  CalcServer::Limits limits;
+  // Only the server takes limits, and the file is evaluated without a cache
+  bool limitsGiven = false;
+  bool cacheGiven = false;
+
+  for (int i = 1; i < argc; ++i) {
+    bool valid = i + 1 < argc;
+
+    if (!std::strcmp(argv[i], "--stats"))
+      valid = statsMode = true;
+    else if (valid && !std::strcmp(argv[i], "--threads"))
+      valid = parseCount(argv[++i], threads) && threads > 0;
+    else if (valid && !std::strcmp(argv[i], "--pipeline"))
+      valid = parseCount(argv[++i], evaluators) && evaluators > 0;
+    else if (valid && !std::strcmp(argv[i], "--cache"))
+      valid = cacheGiven = parseCount(argv[++i], cacheCapacity);
+    else if (valid && !std::strcmp(argv[i], "--cache-bytes"))
+      valid = cacheGiven = parseCount(argv[++i], cacheBytes);
+    else if (valid && !std::strcmp(argv[i], "--file"))
+      filePath = argv[++i];
+    else if (valid && !std::strcmp(argv[i], "--socket"))
+      socketPath = argv[++i];
+    else if (valid && !std::strcmp(argv[i], "--max-connections"))
+      valid = limitsGiven = parseCount(argv[++i], limits.maxConnections) && limits.maxConnections > 0;
+    else
+      valid = false;
+
+    const int modes = (threads > 0) + (evaluators > 0) + !filePath.empty() + !socketPath.empty();
+    if (!valid || modes > 1) {
+      usage();
+      return 1;
+    }
+  }
+
+  if ((limitsGiven && socketPath.empty()) || (cacheGiven && !filePath.empty())) {
+    usage();
+    return 1;
+  }
+
+  static Statistics statistics;
+  Statistics* stats = statsMode ? &statistics : nullptr;
+
+  if (stats)
+    reportOnSignal(statistics);
+
+  int status = 0;
+  PipelineReport report;
+
+  if (!socketPath.empty())
+    status = serve(socketPath, limits, cacheCapacity, cacheBytes, stats);
+  else if (!filePath.empty())
+    status = evaluateFile(filePath, stats);
+  // Batch mode reads the whole input before evaluating it in parallel
+  else if (threads)
+    evaluateBatch(std::cin, threads, std::cout, std::cerr, cacheCapacity, cacheBytes, stats);
+  else if (evaluators)
+    report = evaluatePipeline(STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO, evaluators,
+			      cacheCapacity, cacheBytes, stats);
+  else {
+    LineEvaluator evaluator(cacheCapacity, cacheBytes);
+    evaluator.setStatistics(stats);
+    evaluateLines(evaluator, stats);
+  }
+
+  if (stats) {
+    std::cerr.flush();
+    printStatistics(statistics);
+
+    if (evaluators)
+      printSummary(report.summary());
+  }
+
+  return status;
 }
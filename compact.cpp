@@ -0,0 +1,95 @@
+#include <limits>
+#include <stdexcept>
+#include <utility>
+
+#include "compact.h"
+
+CompactTree CompactTree::parse(const char*& pos, const char* end) {
+  CompactBuilder builder;
+  ExpressionReader<CompactBuilder> reader(pos, end, builder);
+  reader.read();
+
+  CompactTree tree = builder.finish();
+  pos = reader.getPosition();
+  return tree;
+}
+
+double CompactTree::evaluate() const {
+  if (code_.empty())
+    throw std::runtime_error("Evaluating an empty tree");
+
+  // Small trees don't need to touch the heap
+  static const std::size_t localDepth = 64;
+
+  OperandType local[localDepth];
+  std::vector<OperandType> spilled;
+  OperandType* stack = local;
+
+  if (stackDepth_ > localDepth) {
+    spilled.resize(stackDepth_);
+    stack = spilled.data();
+  }
+
+  /* Children come first, so a node's operands are on top of the stack
+     by the time of the node: the right one above the left one */
+  std::size_t top = 0;
+
+  for (std::size_t i = 0; i < code_.size(); ++i) {
+    switch (code_[i]) {
+    case OpCode::Push: stack[top++] = constants_[left_[i]]; break;
+    case OpCode::Negate: stack[top - 1] = -stack[top - 1]; break;
+    case OpCode::Add: --top; stack[top - 1]+= stack[top]; break;
+    case OpCode::Subtract: --top; stack[top - 1]-= stack[top]; break;
+    case OpCode::Multiply: --top; stack[top - 1]*= stack[top]; break;
+    case OpCode::Divide: --top; stack[top - 1]/= stack[top]; break;
+    default: throw std::runtime_error("Unexpected node in a compact tree");
+    }
+  }
+
+  return stack[0];
+}
+
+CompactTree CompactBuilder::finish() {
+  operators_.finish();
+  return std::move(tree_);
+}
+
+std::uint32_t CompactBuilder::append(const OpCode op, const std::uint32_t left, const std::uint32_t right) {
+  if (tree_.code_.size() == std::numeric_limits<std::uint32_t>::max())
+    throw std::length_error("Too many nodes for 32-bit indices");
+
+  tree_.code_.push_back(op);
+  tree_.left_.push_back(left);
+  tree_.right_.push_back(right);
+  return tree_.code_.size() - 1;
+}
+
+void CompactBuilder::operand(const double value) {
+  subtrees_.push_back(append(OpCode::Push, tree_.constants_.size(), 0));
+  tree_.constants_.push_back(value);
+
+  // The subtrees waiting are the values on the evaluation stack
+  if (subtrees_.size() > tree_.stackDepth_)
+    tree_.stackDepth_ = subtrees_.size();
+}
+
+void CompactBuilder::apply(const Operator& op, const bool unary) {
+  if (unary) {
+    if (op.getSymbol() == '-')
+      subtrees_.back() = append(OpCode::Negate, subtrees_.back(), 0);
+    return;
+  }
+
+  const std::uint32_t right = subtrees_.back();
+  subtrees_.pop_back();
+
+  OpCode code;
+  switch (op.getSymbol()) {
+  case '+': code = OpCode::Add; break;
+  case '-': code = OpCode::Subtract; break;
+  case '*': code = OpCode::Multiply; break;
+  default: code = OpCode::Divide; break;
+  }
+
+  subtrees_.back() = append(code, subtrees_.back(), right);
+}
@@ -0,0 +1,126 @@
+#ifndef __COMPACT_H__
+#define __COMPACT_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "bytecode.h"
+#include "reader.h"
+#include "tree.h"
+
+/* An expression tree kept in parallel arrays instead of linked nodes:
+   an opcode and two 32-bit child indices per node, the constants in a
+   pool of their own. A Push node keeps its constant's index in the
+   left child. Nodes are stored children first, in the order the tree
+   would evaluate them, so evaluation is a single pass through the
+   nodes without virtual calls, on a stack as deep as the most values
+   waiting at once and not as long as the tree. Unary pluses and
+   parentheses leave no nodes. */
+class CompactTree {
+public:
+  /* Parses the expression starting at pos as ExpressionParser does,
+     with the same errors, and moves pos past its terminator */
+  static CompactTree parse(const char*& pos, const char* end);
+
+  // Matches the linked tree's result bit for bit
+  double evaluate() const;
+
+  std::size_t getNodeCount() const {
+    return code_.size();
+  }
+
+  std::uint32_t getRoot() const {
+    return code_.size() - 1;
+  }
+
+  OpCode getOpCode(const std::uint32_t node) const {
+    return code_[node];
+  }
+
+  std::uint32_t getLeft(const std::uint32_t node) const {
+    return left_[node];
+  }
+
+  std::uint32_t getRight(const std::uint32_t node) const {
+    return right_[node];
+  }
+
+  const std::vector<OperandType>& getConstants() const {
+    return constants_;
+  }
+
+  void setConstant(const std::size_t index, const OperandType& value) {
+    constants_[index] = value;
+  }
+
+  // The most values waiting at once during evaluation
+  std::size_t getStackDepth() const {
+    return stackDepth_;
+  }
+
+  std::size_t getBytes() const {
+    return code_.size() * (sizeof(OpCode) + 2 * sizeof(std::uint32_t)) + constants_.size() * sizeof(OperandType);
+  }
+
+private:
+  friend class CompactBuilder;
+
+  CompactTree() = default;
+
+  std::vector<OpCode> code_;
+  std::vector<std::uint32_t> left_;
+  std::vector<std::uint32_t> right_;
+  std::vector<OperandType> constants_;
+  std::size_t stackDepth_ = 0;
+};
+
+/* Builds a CompactTree from the same insertions as EvaluationTree
+   takes, appending nodes as soon as their operands are complete. */
+class CompactBuilder {
+public:
+  CompactBuilder(): operators_(*this) { }
+  CompactBuilder(const CompactBuilder&) = delete;
+  CompactBuilder& operator=(const CompactBuilder&) = delete;
+
+  void insertOperand(const OperandType& value) {
+    operators_.insertOperand(value);
+  }
+
+  void insertOperator(const Operator& op) {
+    operators_.insertOperator(op.getSymbol());
+  }
+
+  void openGroup() {
+    operators_.openGroup();
+  }
+
+  void closeGroup() {
+    operators_.closeGroup();
+  }
+
+  bool isReady() const {
+    return operators_.isReady();
+  }
+
+  bool groupOpen() const {
+    return operators_.groupOpen();
+  }
+
+  // Applies the waiting operators and hands the tree over, once
+  CompactTree finish();
+
+  // For the PrecedenceStack
+  void operand(const double);
+  void apply(const Operator&, const bool unary);
+
+private:
+  std::uint32_t append(const OpCode, const std::uint32_t left, const std::uint32_t right);
+
+  CompactTree tree_;
+  // The roots of the complete subtrees that wait for their operators
+  std::vector<std::uint32_t> subtrees_;
+  PrecedenceStack<CompactBuilder> operators_;
+};
+
+#endif
@@ -0,0 +1,173 @@
+#include <cstring>
+#include <functional>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+
+#include "dag.h"
+
+namespace {
+
+struct NodeKey {
+  OpCode op;
+  std::uint32_t left;
+  std::uint32_t right;
+  std::uint64_t bits;
+
+  bool operator==(const NodeKey& rhs) const {
+    return op == rhs.op && left == rhs.left && right == rhs.right && bits == rhs.bits;
+  }
+};
+
+struct NodeKeyHash {
+  std::size_t operator()(const NodeKey& key) const {
+    std::uint64_t hash = static_cast<std::uint64_t>(key.op) * 0x9e3779b97f4a7c15ull;
+    hash^= (static_cast<std::uint64_t>(key.left) << 32 | key.right) + 0x9e3779b97f4a7c15ull + (hash << 6) + (hash >> 2);
+    hash^= key.bits + 0x9e3779b97f4a7c15ull + (hash << 6) + (hash >> 2);
+    return std::hash<std::uint64_t>()(hash);
+  }
+};
+
+OpCode binaryOpCode(const Operator& op) {
+  switch (op.getSymbol()) {
+  case '+': return OpCode::Add;
+  case '-': return OpCode::Subtract;
+  case '*': return OpCode::Multiply;
+  case '/': return OpCode::Divide;
+  default: throw std::runtime_error("Unknown binary operator");
+  }
+}
+
+}
+
+ExpressionDag ExpressionDag::build(const EvaluationTree& tree) {
+  ExpressionDag result;
+  std::unordered_map<NodeKey, std::uint32_t, NodeKeyHash> known;
+
+  // Every subtree is replaced by the index of the node standing for it
+  std::vector<std::uint32_t> operands;
+
+  auto intern = [&result, &known, &operands](const OpCode op, const std::uint32_t left,
+					     const std::uint32_t right, const OperandType value) {
+    NodeKey key = { op, left, right, 0 };
+    std::memcpy(&key.bits, &value, sizeof(value));
+
+    auto inserted = known.emplace(key, static_cast<std::uint32_t>(result.nodes_.size()));
+    if (inserted.second)
+      result.nodes_.push_back({ op, left, right, value });
+
+    operands.push_back(inserted.first->second);
+  };
+
+  const TreeNode* first = static_cast<const RootNode*>(tree.getRoot())->getChild();
+  if (!first)
+    throw std::runtime_error("Building a DAG of an empty tree");
+
+  // The same post-order walk as for compilation
+  std::vector<std::pair<const TreeNode*, bool>> pending;
+  pending.emplace_back(first, false);
+
+  while (!pending.empty()) {
+    const TreeNode* node = pending.back().first;
+    const bool childrenDone = pending.back().second;
+    pending.pop_back();
+
+    switch (node->getKind()) {
+    case NodeKind::Leaf:
+      ++result.treeNodes_;
+      result.treeBytes_+= sizeof(Leaf);
+      intern(OpCode::Push, 0, 0, static_cast<const Leaf*>(node)->getValue());
+      break;
+
+    case NodeKind::Variable:
+      ++result.treeNodes_;
+      result.treeBytes_+= sizeof(Variable);
+      intern(OpCode::Load, static_cast<const Variable*>(node)->getIndex(), 0, 0);
+      break;
+
+    case NodeKind::Unary: {
+      const UnaryNode* unary = static_cast<const UnaryNode*>(node);
+
+      if (!childrenDone) {
+	if (!unary->filled())
+	  throw std::runtime_error("Building a DAG of a unary node without an operand");
+
+	++result.treeNodes_;
+	result.treeBytes_+= sizeof(UnaryNode);
+	pending.emplace_back(node, true);
+	pending.emplace_back(unary->getChild(), false);
+      }
+      else if (unary->getOperator().getSymbol() == '-') {
+	const std::uint32_t operand = operands.back();
+	operands.pop_back();
+	intern(OpCode::Negate, operand, 0, 0);
+      }
+      else if (unary->getOperator().getSymbol() != '+') // Unary plus is a no-op
+	throw std::runtime_error("Unknown unary operator");
+      break;
+    }
+
+    case NodeKind::Binary: {
+      const BinaryNode* binary = static_cast<const BinaryNode*>(node);
+
+      if (!childrenDone) {
+	if (!binary->filled())
+	  throw std::runtime_error("Building a DAG of a binary node without operand(s)");
+
+	result.treeBytes_+= sizeof(BinaryNode);
+	pending.emplace_back(node, true);
+	pending.emplace_back(binary->getRightChild(), false);
+	pending.emplace_back(binary->getLeftChild(), false);
+      }
+      else {
+	++result.treeNodes_;
+	const std::uint32_t right = operands.back();
+	operands.pop_back();
+	const std::uint32_t left = operands.back();
+	operands.pop_back();
+	intern(binaryOpCode(binary->getOperator()), left, right, 0);
+      }
+      break;
+    }
+
+    default:
+      throw std::runtime_error("Unexpected node in expression");
+    }
+  }
+
+  // Nothing smaller could repeat the whole, so it is always the last node
+  return result;
+}
+
+double ExpressionDag::evaluate(const OperandType* variables) const {
+  // Small expressions don't need to touch the heap
+  static const std::size_t localSize = 64;
+
+  OperandType local[localSize];
+  std::vector<OperandType> spilled;
+  OperandType* values = local;
+
+  if (nodes_.size() > localSize) {
+    spilled.resize(nodes_.size());
+    values = spilled.data();
+  }
+
+  // build() never leaves a DAG empty, the last node is always written
+  const std::size_t last = nodes_.size() - 1;
+
+  for (std::size_t i = 0; i <= last; ++i) {
+    const Node& node = nodes_[i];
+
+    switch (node.op) {
+    case OpCode::Push: values[i] = node.value; break;
+    case OpCode::Load: values[i] = variables[node.left]; break;
+    case OpCode::Negate: values[i] = -values[node.left]; break;
+    case OpCode::Add: values[i] = values[node.left] + values[node.right]; break;
+    case OpCode::Subtract: values[i] = values[node.left] - values[node.right]; break;
+    case OpCode::Multiply: values[i] = values[node.left] * values[node.right]; break;
+    case OpCode::Divide: values[i] = values[node.left] / values[node.right]; break;
+    }
+  }
+
+  return values[last];
+}
@@ -0,0 +1,62 @@
+#ifndef __DAG_H__
+#define __DAG_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "bytecode.h"
+#include "tree.h"
+
+/* An expression with its repeated subexpressions merged. Subtrees are
+   hashed by structure, constants by their bits, so that identical ones
+   become a single node which is evaluated once per evaluation. Nodes
+   are stored operands first, which makes evaluation one pass over
+   them; the result matches the tree's bit for bit. */
+class ExpressionDag {
+public:
+  static ExpressionDag build(const EvaluationTree&);
+
+  // Variables are looked up by index in the given array
+  double evaluate(const OperandType* variables = nullptr) const;
+
+  std::size_t getNodeCount() const {
+    return nodes_.size();
+  }
+
+  // The nodes the tree holds, unary pluses too; closed groups are gone
+  std::size_t getTreeNodeCount() const {
+    return treeNodes_;
+  }
+
+  // How many tree nodes every node stands for on average
+  double getDeduplicationRatio() const {
+    return nodes_.empty() ? 1 : static_cast<double>(treeNodes_) / nodes_.size();
+  }
+
+  std::size_t getBytes() const {
+    return nodes_.size() * sizeof(Node);
+  }
+
+  // What the tree nodes take beyond the nodes here
+  std::size_t getBytesSaved() const {
+    return treeBytes_ > getBytes() ? treeBytes_ - getBytes() : 0;
+  }
+
+private:
+  // Operands refer to earlier nodes by index; Load keeps the variable in left
+  struct Node {
+    OpCode op;
+    std::uint32_t left;
+    std::uint32_t right;
+    OperandType value;
+  };
+
+  ExpressionDag() = default;
+
+  std::vector<Node> nodes_;
+  std::size_t treeNodes_ = 0;
+  std::size_t treeBytes_ = 0;
+};
+
+#endif
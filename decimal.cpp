@@ -0,0 +1,17 @@
+#include <cmath>
+
+#include "decimal.h"
+
+namespace {
+
+struct ScaleWithLdexp {
+  static double scale(const double value, const int exponent) {
+    return std::ldexp(value, exponent);
+  }
+};
+
+}
+
+double decimalToDouble(const char* begin, const char* end) {
+  return Decimal::convert<ScaleWithLdexp>(begin, end);
+}
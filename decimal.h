@@ -0,0 +1,308 @@
+#ifndef __DECIMAL_H__
+#define __DECIMAL_H__
+
+#include <cstdint>
+
+/* Converts a run of decimal digits with at most one decimal point
+   ('.' or ',') into the nearest double, ties to even. Works in place,
+   does not allocate and ignores the locale. Short mantissas take a
+   fast path; any length is still rounded correctly. */
+double decimalToDouble(const char* begin, const char* end);
+
+/* The conversion itself, constexpr so that compile-time literals
+   (literal.h) round exactly as decimalToDouble does. The last step,
+   value * 2^exponent of an exact double, is up to the Scale policy:
+   Scale::scale(value, exponent). */
+namespace Decimal {
+
+using uint128 = unsigned __int128;
+
+constexpr bool isDecimalPoint(const char c) {
+  return c == '.' || c == ',';
+}
+
+constexpr int bitLength(uint128 value) {
+  int length = 0;
+
+  if (value >> 64) {
+    value>>= 64;
+    length = 64;
+  }
+
+  return length + (static_cast<std::uint64_t>(value) ? 64 - __builtin_clzll(static_cast<std::uint64_t>(value)) : 0);
+}
+
+/* Rounds value * 2^exponent to the nearest double. The sticky flag
+   says the true value is a bit above that; the caller then has to pass
+   more bits than the result can hold. */
+template <typename Scale>
+constexpr double roundToDouble(uint128 value, int exponent, bool sticky) {
+  if (!value)
+    return 0.0;
+
+  const int length = bitLength(value);
+  const int top = exponent + length - 1;
+
+  // Subnormals have fewer bits of precision
+  const int keep = top < -1022 ? top + 1075 : 53;
+
+  if (keep < 0)
+    return 0.0;
+
+  const int shift = length - keep;
+  if (shift > 0) {
+    const bool roundBit = (value >> (shift - 1)) & 1;
+    sticky = sticky || (value & ((static_cast<uint128>(1) << (shift - 1)) - 1));
+
+    value = shift < 128 ? value >> shift : 0;
+    exponent+= shift;
+
+    if (roundBit && (sticky || (value & 1)))
+      ++value;
+  }
+
+  return Scale::scale(static_cast<double>(static_cast<std::uint64_t>(value)), exponent);
+}
+
+constexpr std::uint32_t smallPowers[] = { 1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000 };
+
+constexpr double exactPowers[] = {
+  1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+/* Fixed-size unsigned integer for the exact slow path. It holds the
+   worst case: 800 digits scaled to the smallest subnormal. */
+class BigInteger {
+public:
+  constexpr BigInteger(const std::uint32_t value = 0): limbs_{ value }, size_(value ? 1 : 0) { }
+
+  constexpr void multiplyAdd(const std::uint32_t factor, const std::uint32_t addend) {
+    std::uint64_t carry = addend;
+
+    for (int i = 0; i < size_; ++i) {
+      carry+= static_cast<std::uint64_t>(limbs_[i]) * factor;
+      limbs_[i] = static_cast<std::uint32_t>(carry);
+      carry>>= 32;
+    }
+
+    if (carry)
+      limbs_[size_++] = static_cast<std::uint32_t>(carry);
+  }
+
+  constexpr void multiplyByPowerOf10(int power) {
+    for (; power >= 9; power-= 9)
+      multiplyAdd(1000000000, 0);
+
+    if (power)
+      multiplyAdd(smallPowers[power], 0);
+  }
+
+  constexpr void shiftLeft(const int bits) {
+    if (!size_)
+      return;
+
+    const int limbShift = bits / 32;
+    const int bitShift = bits % 32;
+
+    if (bitShift) {
+      limbs_[size_] = 0;
+      for (int i = size_; i > 0; --i)
+	limbs_[i] = (limbs_[i] << bitShift) | (limbs_[i - 1] >> (32 - bitShift));
+      limbs_[0]<<= bitShift;
+      ++size_;
+    }
+
+    if (limbShift) {
+      for (int i = size_ - 1; i >= 0; --i)
+	limbs_[i + limbShift] = limbs_[i];
+      for (int i = 0; i < limbShift; ++i)
+	limbs_[i] = 0;
+      size_+= limbShift;
+    }
+
+    trim();
+  }
+
+  constexpr void shiftRightOne() {
+    for (int i = 0; i < size_; ++i)
+      limbs_[i] = (limbs_[i] >> 1) | (i + 1 < size_ ? limbs_[i + 1] << 31 : 0);
+
+    trim();
+  }
+
+  // Only valid when rhs <= *this
+  constexpr void subtract(const BigInteger& rhs) {
+    std::int64_t borrow = 0;
+
+    for (int i = 0; i < size_; ++i) {
+      borrow+= static_cast<std::int64_t>(limbs_[i]) - (i < rhs.size_ ? rhs.limbs_[i] : 0);
+      limbs_[i] = static_cast<std::uint32_t>(borrow);
+      borrow = borrow < 0 ? -1 : 0;
+    }
+
+    trim();
+  }
+
+  constexpr int compare(const BigInteger& rhs) const {
+    if (size_ != rhs.size_)
+      return size_ < rhs.size_ ? -1 : 1;
+
+    for (int i = size_ - 1; i >= 0; --i)
+      if (limbs_[i] != rhs.limbs_[i])
+	return limbs_[i] < rhs.limbs_[i] ? -1 : 1;
+
+    return 0;
+  }
+
+  constexpr int bitLength() const {
+    return size_ ? (size_ - 1) * 32 + 32 - __builtin_clz(limbs_[size_ - 1]) : 0;
+  }
+
+  constexpr bool isZero() const {
+    return !size_;
+  }
+
+private:
+  constexpr void trim() {
+    while (size_ && !limbs_[size_ - 1])
+      --size_;
+  }
+
+  static const int capacity = 132;
+
+  std::uint32_t limbs_[capacity];
+  int size_;
+};
+
+constexpr int maxSignificantDigits = 800;
+
+/* Exact conversion through big integers. Digits past the first 800
+   significant ones only matter as a sticky nonzero tail: a halfway
+   point between two doubles never needs more than 767 of them. */
+template <typename Scale>
+constexpr double slowConversion(const char* begin, const char* end) {
+  BigInteger numerator;
+  int digits = 0;
+  int exponent = 0;
+  bool afterPoint = false;
+  bool truncated = false;
+
+  for (const char* pos = begin; pos != end; ++pos) {
+    if (isDecimalPoint(*pos)) {
+      afterPoint = true;
+      continue;
+    }
+
+    if (afterPoint)
+      --exponent;
+
+    const std::uint32_t digit = *pos - '0';
+    if (digits < maxSignificantDigits) {
+      if (digits || digit) {
+	numerator.multiplyAdd(10, digit);
+	++digits;
+      }
+    }
+    else {
+      ++exponent;
+      truncated = truncated || digit;
+    }
+  }
+
+  if (truncated) {
+    numerator.multiplyAdd(10, 1);
+    ++digits;
+    --exponent;
+  }
+
+  if (numerator.isZero() || digits + exponent < -324)
+    return 0.0;
+  if (digits + exponent > 310)
+    return __builtin_huge_val();
+
+  BigInteger denominator(1);
+  if (exponent >= 0)
+    numerator.multiplyByPowerOf10(exponent);
+  else
+    denominator.multiplyByPowerOf10(-exponent);
+
+  /* The quotient is within a factor of two from 2^(length difference),
+     scaling it so gives 55 or 56 bits: enough to round. */
+  const int scale = 55 - (numerator.bitLength() - denominator.bitLength());
+  if (scale >= 0)
+    numerator.shiftLeft(scale);
+  else
+    denominator.shiftLeft(-scale);
+
+  std::uint64_t quotient = 0;
+  denominator.shiftLeft(55);
+
+  for (int bit = 55; bit >= 0; --bit) {
+    if (numerator.compare(denominator) >= 0) {
+      numerator.subtract(denominator);
+      quotient|= static_cast<std::uint64_t>(1) << bit;
+    }
+
+    denominator.shiftRightOne();
+  }
+
+  return roundToDouble<Scale>(quotient, -scale, !numerator.isZero());
+}
+
+template <typename Scale>
+constexpr double convert(const char* begin, const char* end) {
+  std::uint64_t mantissa = 0;
+  int digits = 0;
+  int exponent = 0;
+  bool afterPoint = false;
+
+  for (const char* pos = begin; pos != end; ++pos) {
+    if (isDecimalPoint(*pos)) {
+      afterPoint = true;
+      continue;
+    }
+
+    const unsigned digit = *pos - '0';
+    if (digits || digit) {
+      mantissa = mantissa * 10 + digit;
+      ++digits;
+    }
+
+    if (afterPoint)
+      --exponent;
+
+    if (digits > 19)
+      return slowConversion<Scale>(begin, end);
+  }
+
+  if (!mantissa)
+    return 0.0;
+
+  // Both operands are exact, so the single operation rounds correctly
+  if (mantissa <= (static_cast<std::uint64_t>(1) << 53) && exponent >= -22 && exponent <= 22)
+    return exponent < 0 ? mantissa / exactPowers[-exponent] : mantissa * exactPowers[exponent];
+
+  // Up to 19 digits against a power of ten below 2^64 fit 128 bits
+  if (exponent >= 0 && exponent <= 19)
+    return roundToDouble<Scale>(static_cast<uint128>(mantissa) * static_cast<std::uint64_t>(exactPowers[exponent]),
+				0, false);
+
+  if (exponent < 0 && exponent >= -19) {
+    const std::uint64_t divisor = static_cast<std::uint64_t>(exactPowers[-exponent]);
+    const int scale = 55 - (bitLength(mantissa) - bitLength(divisor));
+
+    if (scale > 0) {
+      const uint128 scaled = static_cast<uint128>(mantissa) << scale;
+      return roundToDouble<Scale>(scaled / divisor, -scale, scaled % divisor != 0);
+    }
+
+    return roundToDouble<Scale>(mantissa / divisor, 0, mantissa % divisor != 0);
+  }
+
+  return slowConversion<Scale>(begin, end);
+}
+
+}
+
+#endif
@@ -0,0 +1,90 @@
+#include <cstring>
+
+#include "evaluator.h"
+#include "exceptions.h"
+#include "format.h"
+#include "parser.h"
+
+static const char* nextLine(const char* pos, const char* end) {
+  const void* eol = std::memchr(pos, '\n', end - pos);
+  return eol ? static_cast<const char*>(eol) + 1 : end;
+}
+
+// Reuses the text's storage instead of building a new string
+static void setResult(const double value, std::string& text, Statistics* stats) {
+  PhaseTimer timer(stats, Statistics::FormatTime);
+  char buffer[formatBufferSize];
+  text.assign(buffer, formatDouble(value, buffer));
+}
+
+static ExpressionParser parse(const char* pos, const char* end, NodeArena& arena, Statistics* stats) {
+  PhaseTimer timer(stats, Statistics::ParseTime);
+  return ExpressionParser::parseBuffer(pos, end, arena);
+}
+
+LineEvaluator::LineEvaluator(const std::size_t cacheCapacity, const std::size_t cacheBytes) {
+  if (cacheCapacity || cacheBytes)
+    cache_.reset(new ResultCache(cacheCapacity, cacheBytes));
+}
+
+LineEvaluator::Outcome LineEvaluator::evaluateLine(const char*& pos, const char* end, std::string& text) {
+  double value;
+
+  if (stats_)
+    stats_->add(Statistics::Lines, 1);
+
+  if (cache_) {
+    // The line break is whitespace too and gets trimmed
+    const char* next = nextLine(pos, end);
+    ResultCache::normalize(pos, next, key_);
+
+    if (!key_.empty() && cache_->find(key_, value)) {
+      if (stats_) {
+	stats_->add(Statistics::Expressions, 1);
+	stats_->add(Statistics::CacheHits, 1);
+      }
+
+      setResult(value, text, stats_);
+      pos = next;
+      return Outcome::Result;
+    }
+  }
+
+  arena_.reset();
+  const std::size_t created = arena_.getObjectsCreated();
+
+  try {
+    auto parser = parse(pos, end, arena_, stats_);
+    pos = parser.getPosition();
+
+    if (stats_)
+      stats_->add(Statistics::NodesBuilt, arena_.getObjectsCreated() - created);
+
+    if (parser.nothingRead())
+      return Outcome::Nothing;
+
+    PhaseTimer timer(stats_, Statistics::EvaluateTime);
+    value = parser.getTree().evaluate();
+  }
+  catch (Exceptions::ParsingException& e) {
+    if (stats_) {
+      stats_->add(Statistics::NodesBuilt, arena_.getObjectsCreated() - created);
+      stats_->countError(e);
+    }
+
+    // Positions are per line, so the next one starts afresh
+    text = e.what();
+    pos = nextLine(pos, end);
+    return Outcome::Error;
+  }
+
+  // Failed lines are not cached: their error positions depend on spacing
+  if (cache_)
+    cache_->insert(key_, value);
+
+  if (stats_)
+    stats_->add(Statistics::Expressions, 1);
+
+  setResult(value, text, stats_);
+  return Outcome::Result;
+}
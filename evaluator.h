@@ -0,0 +1,47 @@
+#ifndef __EVALUATOR_H__
+#define __EVALUATOR_H__
+
+#include <memory>
+#include <string>
+
+#include "arena.h"
+#include "cache.h"
+#include "stats.h"
+
+/* Evaluates input one line at a time the way calc does, reusing its
+   arena (and its cache, if any) from line to line. */
+class LineEvaluator {
+public:
+  enum class Outcome {
+    Nothing, // Blank line
+    Result,
+    Error
+  };
+
+  LineEvaluator() = default;
+  // A zero capacity and size turns the cache off
+  LineEvaluator(const std::size_t cacheCapacity, const std::size_t cacheBytes);
+
+  /* Evaluates the line starting at pos and moves pos to the next one.
+     The text receives the formatted result or the error message. */
+  Outcome evaluateLine(const char*& pos, const char* end, std::string& text);
+
+  const ResultCache* getCache() const {
+    return cache_.get();
+  }
+
+  // Counts and times the lines from now on; null turns that off
+  void setStatistics(Statistics* stats) {
+    stats_ = stats;
+  }
+
+private:
+  NodeArena arena_;
+
+  std::unique_ptr<ResultCache> cache_;
+  std::string key_;
+
+  Statistics* stats_ = nullptr;
+};
+
+#endif
@@ -0,0 +1,90 @@
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+
+#include "format.h"
+
+using uint128 = unsigned __int128;
+
+// Drops zeros after the decimal point, and the point if nothing is left
+static std::size_t trimZeros(const char* buffer, std::size_t length) {
+  while (length && buffer[length - 1] == '0')
+    --length;
+
+  if (length && buffer[length - 1] == '.')
+    --length;
+
+  return length;
+}
+
+// Rare cases: infinities, NaNs and values above 2^64
+static std::size_t formatSlowly(const double val, char* buffer) {
+  const int length = std::snprintf(buffer, formatBufferSize, "%.2f", val);
+
+  for (int i = 0; i < length; ++i)
+    if (buffer[i] == '.')
+      return trimZeros(buffer, length);
+
+  return length;
+}
+
+std::size_t formatDouble(const double val, char* buffer) {
+  static const double limit = 18446744073709551616.0; // 2^64
+
+  if (!std::isfinite(val) || std::fabs(val) >= limit)
+    return formatSlowly(val, buffer);
+
+  /* |val| = mantissa * 2^exponent exactly, so the number of cents is
+     an exact integer shifted by the exponent */
+  int exponent;
+  const double fraction = std::frexp(std::fabs(val), &exponent);
+  const std::uint64_t mantissa = static_cast<std::uint64_t>(std::ldexp(fraction, 53));
+  exponent-= 53;
+
+  uint128 cents = static_cast<uint128>(mantissa) * 100;
+
+  if (exponent >= 0)
+    cents<<= exponent;
+  else {
+    const int shift = -exponent;
+    const uint128 rest = shift < 128 ? cents & ((static_cast<uint128>(1) << shift) - 1) : cents;
+    const uint128 half = shift < 129 ? static_cast<uint128>(1) << (shift - 1) : 0;
+
+    cents = shift < 128 ? cents >> shift : 0;
+    if (half && (rest > half || (rest == half && (cents & 1))))
+      ++cents;
+  }
+
+  // Digits go backwards from the end of a scratch area
+  char digits[48];
+  char* pos = digits + sizeof(digits);
+
+  const unsigned fractional = static_cast<unsigned>(cents % 100);
+  uint128 integral = cents / 100;
+
+  if (fractional) {
+    if (fractional % 10)
+      *--pos = '0' + fractional % 10;
+    *--pos = '0' + fractional / 10;
+    *--pos = '.';
+  }
+
+  do {
+    *--pos = '0' + static_cast<unsigned>(integral % 10);
+    integral/= 10;
+  } while (integral);
+
+  std::size_t length = 0;
+  if (std::signbit(val))
+    buffer[length++] = '-';
+
+  while (pos != digits + sizeof(digits))
+    buffer[length++] = *pos++;
+
+  return length;
+}
+
+std::string formatDouble(const double val) {
+  char buffer[formatBufferSize];
+  return std::string(buffer, formatDouble(val, buffer));
+}
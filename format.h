@@ -0,0 +1,17 @@
+#ifndef __FORMAT_H__
+#define __FORMAT_H__
+
+#include <cstddef>
+#include <string>
+
+// Enough for any double, the largest ones have 309 integer digits
+const std::size_t formatBufferSize = 320;
+
+/* Rounds to two decimal places and drops trailing zeros. Writes into
+   the buffer without terminating it and returns the length. Rounding
+   is exact, with ties to even, just like printf's. */
+std::size_t formatDouble(const double, char* buffer);
+
+std::string formatDouble(const double);
+
+#endif
@@ -0,0 +1,40 @@
+#include <cstdlib>
+
+#include "generator.h"
+
+int randInt(const int from, const int to) {
+  return (std::rand() % (to - from + 1)) + from;
+}
+
+std::shared_ptr<Expr> generateRandomExpression(unsigned depth) {
+  /* My random is so big you can't handle it */
+  const int choice = depth < 8 ? randInt(0, 2) : 0;
+  switch(choice) {
+  case 0: {
+    auto numExpr = std::make_shared<Number>();
+    numExpr->num = static_cast<double>(randInt(-10000, 10000)) / 100.0;
+    return numExpr;
+  }
+  case 1: {
+    auto operExpr = std::make_shared<OperationsChain>();
+    const int chainSize = randInt(2, 4);
+    const int chainPriority = randInt(0, 1);
+
+    operExpr->operChain.reserve(chainSize);
+    operExpr->signChain.reserve(chainSize - 1);
+
+    for (int i = 0; i < chainSize; ++i) {
+      if (i > 0)
+	operExpr->signChain.push_back(static_cast<short>(chainPriority * 2 + randInt(0, 1)));
+      operExpr->operChain.push_back(generateRandomExpression(depth+1));
+    }
+
+    return operExpr;
+  }
+  default: {
+    auto blExpr = std::make_shared<Block>();
+    blExpr->content = generateRandomExpression(depth+1);
+    return blExpr;
+  }
+  }
+}
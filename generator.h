@@ -0,0 +1,73 @@
+#ifndef __GENERATOR_H__
+#define __GENERATOR_H__
+
+#include <iomanip>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/* Random expressions along with the values they should evaluate to,
+   shared by the tests and the benchmarks. They draw on std::rand, so
+   seeding it with std::srand makes them reproducible. */
+struct Expr {
+  virtual ~Expr() = default;
+  virtual std::string serialize() const = 0;
+  virtual double evaluate() const = 0;
+};
+
+struct OperationsChain: Expr {
+  std::string serialize() const override { 
+    static std::string vals = "+-*/";
+    std::ostringstream ser;
+    
+    ser << "(" << operChain.front()->serialize();
+    for (size_t i = 1; i < operChain.size(); ++i) {
+      ser << vals[signChain[i-1]] << operChain[i]->serialize();
+    }
+    ser << ")";
+
+    return ser.str();
+  }
+
+  double evaluate() const override {
+    double result = operChain.front()->evaluate();
+
+    for (size_t i = 1; i < operChain.size(); ++i) {
+      switch(signChain[i-1]) {
+      case 0: result+= operChain[i]->evaluate(); break;
+      case 1: result-= operChain[i]->evaluate(); break;
+      case 2: result*= operChain[i]->evaluate(); break;
+      default: result/= operChain[i]->evaluate(); break;
+      }
+    }
+
+    return result;
+  }
+
+  std::vector<std::shared_ptr<Expr>> operChain;
+  std::vector<short> signChain;
+};
+
+struct Block: Expr {
+  std::string serialize() const override { return std::string("(") + content->serialize() + ")"; }
+  double evaluate() const override { return content->evaluate(); }
+
+  std::shared_ptr<Expr> content;
+};
+
+struct Number: Expr {
+  std::string serialize() const override { 
+    std::ostringstream str;
+    str << std::setprecision(2) << std::fixed << num;
+    return str.str();
+  }
+  double evaluate() const override { return num; }
+
+  double num;
+};
+
+int randInt(const int from, const int to);
+std::shared_ptr<Expr> generateRandomExpression(unsigned depth = 0);
+
+#endif
@@ -0,0 +1,357 @@
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <system_error>
+#include <vector>
+
+#if defined(__x86_64__)
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include "jit.h"
+
+#if defined(__x86_64__)
+
+namespace {
+
+// Just enough of the SSE2 encoding for the arithmetic of scalar doubles
+class Assembler {
+public:
+  enum SseOp: unsigned char {
+    Add = 0x58,
+    Multiply = 0x59,
+    Subtract = 0x5c,
+    Divide = 0x5e
+  };
+
+  static const int scratch = 15;
+
+  // movsd xmm, [rip + constant]
+  void loadConstant(const int reg, const std::size_t index) {
+    sse(0xf2, 0x10, reg, 0);
+    emit(0x05 | (reg & 7) << 3);
+    ripFixup(constantOffset + index * sizeof(double));
+  }
+
+  // movsd xmm, [rdi + 8 * variable]
+  void loadVariable(const int reg, const std::uint32_t index) {
+    sse(0xf2, 0x10, reg, 0);
+    emit(0x87 | (reg & 7) << 3);
+    emit32(index * sizeof(double));
+  }
+
+  // movsd xmm, [rsp + offset] and back
+  void loadSpilled(const int reg, const std::uint32_t offset) {
+    sse(0xf2, 0x10, reg, 0);
+    stackOperand(reg, offset);
+  }
+
+  void storeSpilled(const std::uint32_t offset, const int reg) {
+    sse(0xf2, 0x11, reg, 0);
+    stackOperand(reg, offset);
+  }
+
+  // op xmm, xmm
+  void arithmetic(const SseOp op, const int reg, const int source) {
+    sse(0xf2, op, reg, source);
+    emit(0xc0 | (reg & 7) << 3 | (source & 7));
+  }
+
+  // op xmm, [rsp + offset]
+  void arithmeticSpilled(const SseOp op, const int reg, const std::uint32_t offset) {
+    sse(0xf2, op, reg, 0);
+    stackOperand(reg, offset);
+  }
+
+  // xorpd xmm, [rip + sign mask]
+  void negate(const int reg) {
+    sse(0x66, 0x57, reg, 0);
+    emit(0x05 | (reg & 7) << 3);
+    ripFixup(signMaskOffset);
+  }
+
+  // sub rsp, size / add rsp, size
+  void adjustStack(const bool grow, const std::uint32_t size) {
+    emit(0x48);
+    emit(0x81);
+    emit(grow ? 0xec : 0xc4);
+    emit32(size);
+  }
+
+  void ret() {
+    emit(0xc3);
+  }
+
+  /* The data goes after the code: the sign mask aligned for xorpd,
+     then the constants */
+  std::vector<unsigned char> link(const std::vector<OperandType>& constants) {
+    std::vector<unsigned char> image(code_);
+    image.resize((image.size() + 15) & ~static_cast<std::size_t>(15));
+
+    const std::size_t data = image.size();
+    const std::uint64_t mask[2] = { 0x8000000000000000ull, 0 };
+    image.resize(data + sizeof(mask) + constants.size() * sizeof(double));
+    std::memcpy(image.data() + data, mask, sizeof(mask));
+    if (!constants.empty())
+      std::memcpy(image.data() + data + sizeof(mask), constants.data(), constants.size() * sizeof(double));
+
+    // Displacements count from the end of the instruction, which ends with them
+    for (const auto& fixup : fixups_) {
+      const std::int32_t displacement = static_cast<std::int32_t>(data + fixup.second - (fixup.first + 4));
+      std::memcpy(image.data() + fixup.first, &displacement, sizeof(displacement));
+    }
+
+    return image;
+  }
+
+  std::size_t size() const {
+    return code_.size();
+  }
+
+private:
+  static const std::size_t signMaskOffset = 0;
+  static const std::size_t constantOffset = 16;
+
+  void emit(const unsigned char byte) {
+    code_.push_back(byte);
+  }
+
+  void emit32(const std::uint32_t value) {
+    for (int i = 0; i < 4; ++i)
+      emit(value >> (8 * i) & 0xff);
+  }
+
+  // Prefix, REX for the upper registers and the two-byte opcode
+  void sse(const unsigned char prefix, const unsigned char opcode, const int reg, const int rm) {
+    emit(prefix);
+    if (reg >= 8 || rm >= 8)
+      emit(0x40 | (reg >= 8) << 2 | (rm >= 8));
+    emit(0x0f);
+    emit(opcode);
+  }
+
+  void stackOperand(const int reg, const std::uint32_t offset) {
+    emit(0x84 | (reg & 7) << 3);
+    emit(0x24);
+    emit32(offset);
+  }
+
+  void ripFixup(const std::size_t dataOffset) {
+    fixups_.emplace_back(code_.size(), dataOffset);
+    emit32(0);
+  }
+
+  std::vector<unsigned char> code_;
+  // Where a displacement goes, and what it points to within the data
+  std::vector<std::pair<std::size_t, std::size_t>> fixups_;
+};
+
+// The first stack slots are registers, the rest live on the C++ stack
+const std::size_t registerSlots = 15;
+
+bool inRegister(const std::size_t slot) {
+  return slot < registerSlots;
+}
+
+std::uint32_t spillOffset(const std::size_t slot) {
+  return (slot - registerSlots) * sizeof(double);
+}
+
+Assembler::SseOp sseOp(const OpCode op) {
+  switch (op) {
+  case OpCode::Add: return Assembler::Add;
+  case OpCode::Subtract: return Assembler::Subtract;
+  case OpCode::Multiply: return Assembler::Multiply;
+  default: return Assembler::Divide;
+  }
+}
+
+std::vector<unsigned char> generate(const CompiledExpression& program) {
+  Assembler as;
+
+  const std::size_t spilled = program.getStackDepth() > registerSlots ? program.getStackDepth() - registerSlots : 0;
+  const std::uint32_t frame = (spilled * sizeof(double) + 15) & ~15u;
+  if (frame)
+    as.adjustStack(true, frame);
+
+  std::size_t depth = 0;
+  std::size_t constant = 0;
+  std::size_t slot = 0;
+
+  // Pushes go straight to a register, or through the scratch one
+  auto push = [&](const bool isConstant) {
+    const int reg = inRegister(depth) ? depth : Assembler::scratch;
+
+    if (isConstant)
+      as.loadConstant(reg, constant++);
+    else
+      as.loadVariable(reg, program.getSlots()[slot++]);
+
+    if (!inRegister(depth))
+      as.storeSpilled(spillOffset(depth), reg);
+    ++depth;
+  };
+
+  for (const OpCode op : program.getCode()) {
+    switch (op) {
+    case OpCode::Push: push(true); break;
+    case OpCode::Load: push(false); break;
+
+    case OpCode::Negate: {
+      const std::size_t top = depth - 1;
+
+      if (inRegister(top))
+	as.negate(top);
+      else {
+	as.loadSpilled(Assembler::scratch, spillOffset(top));
+	as.negate(Assembler::scratch);
+	as.storeSpilled(spillOffset(top), Assembler::scratch);
+      }
+      break;
+    }
+
+    default: {
+      const std::size_t left = depth - 2;
+      const std::size_t right = depth - 1;
+
+      if (inRegister(right))
+	as.arithmetic(sseOp(op), left, right);
+      else if (inRegister(left))
+	as.arithmeticSpilled(sseOp(op), left, spillOffset(right));
+      else {
+	as.loadSpilled(Assembler::scratch, spillOffset(left));
+	as.arithmeticSpilled(sseOp(op), Assembler::scratch, spillOffset(right));
+	as.storeSpilled(spillOffset(left), Assembler::scratch);
+      }
+
+      --depth;
+    }
+    }
+  }
+
+  // The result is in xmm0 already, as the calling convention wants it
+  if (frame)
+    as.adjustStack(false, frame);
+  as.ret();
+
+  return as.link(program.getConstants());
+}
+
+}
+
+bool JitFunction::supported() {
+  return true;
+}
+
+JitFunction::JitFunction(const CompiledExpression& program): program_(program) {
+  const std::vector<unsigned char> image = generate(program);
+
+  const std::size_t page = sysconf(_SC_PAGESIZE);
+  mappedSize_ = (image.size() + page - 1) / page * page;
+
+  memory_ = mmap(nullptr, mappedSize_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (memory_ == MAP_FAILED) {
+    memory_ = nullptr;
+    throw std::system_error(errno, std::generic_category(), "mmap");
+  }
+
+  std::memcpy(memory_, image.data(), image.size());
+
+  // Never writable and executable at once
+  if (mprotect(memory_, mappedSize_, PROT_READ | PROT_EXEC)) {
+    const int error = errno;
+    munmap(memory_, mappedSize_);
+    throw std::system_error(error, std::generic_category(), "mprotect");
+  }
+
+  codeSize_ = image.size();
+  function_ = reinterpret_cast<Function>(memory_);
+}
+
+JitFunction::~JitFunction() {
+  if (memory_)
+    munmap(memory_, mappedSize_);
+}
+
+#else
+
+bool JitFunction::supported() {
+  return false;
+}
+
+JitFunction::JitFunction(const CompiledExpression& program): program_(program) { }
+
+JitFunction::~JitFunction() { }
+
+#endif
+
+JitFunction::JitFunction(JitFunction&& rhs): program_(std::move(rhs.program_)), memory_(rhs.memory_),
+					      mappedSize_(rhs.mappedSize_), codeSize_(rhs.codeSize_),
+					      function_(rhs.function_) {
+  rhs.memory_ = nullptr;
+  rhs.function_ = nullptr;
+}
+
+JitFunction JitFunction::compile(const CompiledExpression& program) {
+  return JitFunction(program);
+}
+
+JitFunction JitFunction::compile(const EvaluationTree& tree) {
+  return JitFunction(CompiledExpression::compile(tree));
+}
+
+std::string JitCache::makeKey(const CompiledExpression& program) {
+  const auto& code = program.getCode();
+  const auto& constants = program.getConstants();
+  const auto& slots = program.getSlots();
+
+  // The bits of the constants, so that -0 and 0 differ
+  std::string key(reinterpret_cast<const char*>(code.data()), code.size());
+  key.append(reinterpret_cast<const char*>(constants.data()), constants.size() * sizeof(OperandType));
+  key.append(reinterpret_cast<const char*>(slots.data()), slots.size() * sizeof(std::uint32_t));
+
+  return key;
+}
+
+std::shared_ptr<const JitFunction> JitCache::get(const CompiledExpression& program) {
+  const std::string key = makeKey(program);
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  auto it = index_.find(key);
+  if (it != index_.end()) {
+    ++hits_;
+    entries_.splice(entries_.begin(), entries_, it->second);
+    return it->second->second;
+  }
+
+  ++misses_;
+  std::shared_ptr<const JitFunction> function(new JitFunction(JitFunction::compile(program)));
+
+  if (capacity_) {
+    if (index_.size() == capacity_) {
+      index_.erase(entries_.back().first);
+      entries_.pop_back();
+    }
+
+    entries_.emplace_front(key, function);
+    index_.emplace(key, entries_.begin());
+  }
+
+  return function;
+}
+
+std::size_t JitCache::size() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return index_.size();
+}
+
+std::size_t JitCache::getHits() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return hits_;
+}
+
+std::size_t JitCache::getMisses() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return misses_;
+}
@@ -0,0 +1,86 @@
+#ifndef __JIT_H__
+#define __JIT_H__
+
+#include <cstddef>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+#include "bytecode.h"
+#include "tree.h"
+
+/* Native x86-64 code for a compiled expression. The stack of the
+   program lives in xmm0-xmm14 and spills to memory when deeper, with
+   xmm15 for scratch. The code is written to a private mapping which is
+   made executable only once it is no longer writable. Elsewhere there
+   is no native function and evaluate() runs the interpreter. */
+class JitFunction {
+public:
+  // Variables are looked up by index in the array
+  using Function = double (*)(const OperandType* variables);
+
+  static bool supported();
+
+  static JitFunction compile(const CompiledExpression&);
+  static JitFunction compile(const EvaluationTree&);
+
+  JitFunction(JitFunction&&);
+  ~JitFunction();
+  JitFunction(const JitFunction&) = delete;
+  JitFunction& operator=(const JitFunction&) = delete;
+
+  // Null where the JIT is not supported
+  Function getFunction() const {
+    return function_;
+  }
+
+  double evaluate(const OperandType* variables = nullptr) const {
+    return function_ ? function_(variables) : program_.evaluate(variables);
+  }
+
+  std::size_t getCodeSize() const {
+    return codeSize_;
+  }
+
+private:
+  explicit JitFunction(const CompiledExpression&);
+
+  CompiledExpression program_;
+
+  void* memory_ = nullptr;
+  std::size_t mappedSize_ = 0;
+  std::size_t codeSize_ = 0;
+  Function function_ = nullptr;
+};
+
+/* Compiled functions of the most recently used programs. Evicted ones
+   live on as long as someone holds them. Safe to share among threads. */
+class JitCache {
+public:
+  explicit JitCache(const std::size_t capacity): capacity_(capacity) { }
+
+  std::shared_ptr<const JitFunction> get(const CompiledExpression&);
+
+  std::size_t size() const;
+
+  std::size_t getHits() const;
+  std::size_t getMisses() const;
+
+private:
+  using Entry = std::pair<std::string, std::shared_ptr<const JitFunction>>;
+
+  static std::string makeKey(const CompiledExpression&);
+
+  std::size_t capacity_;
+  std::size_t hits_ = 0;
+  std::size_t misses_ = 0;
+
+  mutable std::mutex mutex_;
+  std::list<Entry> entries_;
+  std::unordered_map<std::string, std::list<Entry>::iterator> index_;
+};
+
+#endif
@@ -0,0 +1,337 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <system_error>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "library.h"
+
+using namespace LibraryFormat;
+
+static const std::uint64_t fnvPrime = 1099511628211ull;
+
+void Checksum::update(const void* data, std::size_t size) {
+  const unsigned char* bytes = static_cast<const unsigned char*>(data);
+
+  while (pendingSize_ && size) {
+    pending_[pendingSize_++] = *bytes++;
+    --size;
+
+    if (pendingSize_ == sizeof(pending_)) {
+      std::uint64_t word;
+      std::memcpy(&word, pending_, sizeof(word));
+      state_ = (state_ ^ word) * fnvPrime;
+      pendingSize_ = 0;
+    }
+  }
+
+  for (; size >= sizeof(std::uint64_t); bytes+= sizeof(std::uint64_t), size-= sizeof(std::uint64_t)) {
+    std::uint64_t word;
+    std::memcpy(&word, bytes, sizeof(word));
+    state_ = (state_ ^ word) * fnvPrime;
+  }
+
+  std::memcpy(pending_, bytes, size);
+  pendingSize_ = size;
+}
+
+std::uint64_t Checksum::get() const {
+  if (!pendingSize_)
+    return state_;
+
+  std::uint64_t word = 0;
+  std::memcpy(&word, pending_, pendingSize_);
+  return (state_ ^ word) * fnvPrime;
+}
+
+void LibraryWriter::add(const CompiledExpression& program, const std::vector<std::string>& variables) {
+  const auto& code = program.getCode();
+  const auto& constants = program.getConstants();
+  const auto& slots = program.getSlots();
+
+  if (code.size() > UINT32_MAX || program.getStackDepth() > UINT32_MAX)
+    throw std::runtime_error("Expression too large for a library");
+
+  Entry entry = { code_.size(), constants_.size(), slots_.size(), names_.size(),
+		  static_cast<std::uint32_t>(code.size()), static_cast<std::uint32_t>(program.getStackDepth()),
+		  0, 0 };
+
+  // Variables the names leave out get empty ones
+  std::size_t count = variables.size();
+  for (const std::uint32_t slot : slots)
+    count = std::max<std::size_t>(count, slot + 1);
+  entry.variables = count;
+
+  for (std::size_t i = 0; i < count; ++i) {
+    if (i < variables.size())
+      names_+= variables[i];
+    names_.push_back('\0');
+  }
+
+  code_.insert(code_.end(), code.begin(), code.end());
+  constants_.insert(constants_.end(), constants.begin(), constants.end());
+  slots_.insert(slots_.end(), slots.begin(), slots.end());
+  entries_.push_back(entry);
+}
+
+void LibraryWriter::add(const PreparedExpression& expression) {
+  std::vector<std::string> variables;
+  for (std::size_t i = 0; i < expression.getVariableCount(); ++i)
+    variables.push_back(expression.getVariableName(i));
+
+  add(expression.getProgram(), variables);
+}
+
+static void writeAll(const int fd, const void* data, std::size_t size) {
+  const char* bytes = static_cast<const char*>(data);
+
+  while (size) {
+    const ssize_t written = write(fd, bytes, size);
+
+    if (written < 0) {
+      if (errno == EINTR)
+	continue;
+      throw std::system_error(errno, std::generic_category(), "write");
+    }
+
+    bytes+= written;
+    size-= written;
+  }
+}
+
+void LibraryWriter::save(const std::string& path) const {
+  Header header;
+  std::memcpy(header.magic, magic, sizeof(magic));
+  header.version = version;
+  header.byteOrder = byteOrderMarker;
+  header.expressions = entries_.size();
+  header.constants = constants_.size();
+  header.slots = slots_.size();
+  header.codeBytes = code_.size();
+  header.nameBytes = names_.size();
+
+  const std::pair<const void*, std::size_t> sections[] = {
+    { entries_.data(), entries_.size() * sizeof(Entry) },
+    { constants_.data(), constants_.size() * sizeof(OperandType) },
+    { slots_.data(), slots_.size() * sizeof(std::uint32_t) },
+    { code_.data(), code_.size() * sizeof(OpCode) },
+    { names_.data(), names_.size() }
+  };
+  static const char zeros[8] = { };
+
+  Checksum checksum;
+  for (const auto& section : sections) {
+    checksum.update(section.first, section.second);
+    checksum.update(zeros, padded(section.second) - section.second);
+  }
+  header.checksum = checksum.get();
+
+  // Readers of the old file keep their mapping of it
+  const std::string temporary = path + ".tmp";
+  const int fd = ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0)
+    throw std::system_error(errno, std::generic_category(), temporary);
+
+  try {
+    writeAll(fd, &header, sizeof(header));
+    for (const auto& section : sections) {
+      writeAll(fd, section.first, section.second);
+      writeAll(fd, zeros, padded(section.second) - section.second);
+    }
+
+    if (::close(fd))
+      throw std::system_error(errno, std::generic_category(), "close");
+  }
+  catch (...) {
+    ::close(fd);
+    unlink(temporary.c_str());
+    throw;
+  }
+
+  if (rename(temporary.c_str(), path.c_str())) {
+    const int error = errno;
+    unlink(temporary.c_str());
+    throw std::system_error(error, std::generic_category(), path);
+  }
+}
+
+ExpressionLibrary ExpressionLibrary::open(const std::string& path, const bool verify) {
+  const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    throw std::system_error(errno, std::generic_category(), path);
+
+  struct stat status;
+  if (fstat(fd, &status)) {
+    const int error = errno;
+    ::close(fd);
+    throw std::system_error(error, std::generic_category(), path);
+  }
+
+  const std::size_t size = status.st_size;
+  if (size < sizeof(Header)) {
+    ::close(fd);
+    throw std::runtime_error("Not an expression library: " + path);
+  }
+
+  ExpressionLibrary library;
+  library.memory_ = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  const int error = errno;
+  ::close(fd);
+
+  if (library.memory_ == MAP_FAILED) {
+    library.memory_ = nullptr;
+    throw std::system_error(error, std::generic_category(), "mmap");
+  }
+  library.mappedSize_ = size;
+
+  const char* base = static_cast<const char*>(library.memory_);
+  const Header& header = *reinterpret_cast<const Header*>(base);
+
+  if (std::memcmp(header.magic, magic, sizeof(magic)))
+    throw std::runtime_error("Not an expression library: " + path);
+  if (header.byteOrder != byteOrderMarker)
+    throw std::runtime_error("Expression library of another byte order: " + path);
+  if (header.version != version)
+    throw std::runtime_error("Unsupported expression library version " + std::to_string(header.version));
+
+  // Counts too large for the file are refused before they can overflow
+  const std::uint64_t counts[] = { header.expressions, header.constants, header.slots, header.codeBytes, header.nameBytes };
+  const std::size_t elementSizes[] = { sizeof(Entry), sizeof(OperandType), sizeof(std::uint32_t), sizeof(OpCode), 1 };
+  const void* starts[5];
+  std::size_t offset = sizeof(Header);
+
+  for (int i = 0; i < 5; ++i) {
+    if (counts[i] > size / elementSizes[i])
+      throw std::runtime_error("Truncated expression library: " + path);
+
+    starts[i] = base + offset;
+    offset+= padded(counts[i] * elementSizes[i]);
+  }
+
+  if (offset != size)
+    throw std::runtime_error("Truncated expression library: " + path);
+
+  library.header_ = &header;
+  library.entries_ = static_cast<const Entry*>(starts[0]);
+  library.constants_ = static_cast<const OperandType*>(starts[1]);
+  library.slots_ = static_cast<const std::uint32_t*>(starts[2]);
+  library.code_ = static_cast<const OpCode*>(starts[3]);
+  library.names_ = static_cast<const char*>(starts[4]);
+
+  if (verify) {
+    Checksum checksum;
+    checksum.update(base + sizeof(Header), size - sizeof(Header));
+
+    if (checksum.get() != header.checksum)
+      throw std::runtime_error("Expression library checksum mismatch: " + path);
+
+    library.verifyPrograms();
+  }
+
+  return library;
+}
+
+static void invalidExpression(const std::size_t index) {
+  throw std::runtime_error("Invalid expression " + std::to_string(index) + " in library");
+}
+
+void ExpressionLibrary::verifyPrograms() const {
+  const Header& header = *header_;
+
+  for (std::size_t i = 0; i < header.expressions; ++i) {
+    const Entry& entry = entries_[i];
+
+    if (entry.code > header.codeBytes || entry.codeSize > header.codeBytes - entry.code ||
+	entry.constants > header.constants || entry.slots > header.slots || entry.names > header.nameBytes)
+      invalidExpression(i);
+
+    // The stack stays within its depth and ends with the single result
+    std::uint64_t constants = entry.constants, slots = entry.slots;
+    std::size_t depth = 0, maxDepth = 0;
+
+    for (const OpCode* op = code_ + entry.code; op != code_ + entry.code + entry.codeSize; ++op) {
+      switch (*op) {
+      case OpCode::Push:
+	if (constants++ == header.constants)
+	  invalidExpression(i);
+	++depth;
+	break;
+      case OpCode::Load:
+	if (slots == header.slots || slots_[slots++] >= entry.variables)
+	  invalidExpression(i);
+	++depth;
+	break;
+      case OpCode::Negate:
+	if (!depth)
+	  invalidExpression(i);
+	break;
+      case OpCode::Add:
+      case OpCode::Subtract:
+      case OpCode::Multiply:
+      case OpCode::Divide:
+	if (depth < 2)
+	  invalidExpression(i);
+	--depth;
+	break;
+      default:
+	invalidExpression(i);
+      }
+
+      maxDepth = std::max(maxDepth, depth);
+    }
+
+    if (depth != 1 || maxDepth > entry.stackDepth)
+      invalidExpression(i);
+
+    // One name for every variable
+    const char* name = names_ + entry.names;
+    const char* namesEnd = names_ + header.nameBytes;
+    for (std::size_t k = 0; k < entry.variables; ++k, ++name) {
+      name = static_cast<const char*>(std::memchr(name, '\0', namesEnd - name));
+      if (!name)
+	invalidExpression(i);
+    }
+  }
+}
+
+ExpressionLibrary::ExpressionLibrary(ExpressionLibrary&& rhs):
+  memory_(rhs.memory_), mappedSize_(rhs.mappedSize_), header_(rhs.header_), entries_(rhs.entries_),
+  constants_(rhs.constants_), slots_(rhs.slots_), code_(rhs.code_), names_(rhs.names_) {
+  rhs.memory_ = nullptr;
+}
+
+ExpressionLibrary::~ExpressionLibrary() {
+  if (memory_)
+    munmap(memory_, mappedSize_);
+}
+
+double ExpressionLibrary::evaluate(const std::size_t index, const OperandType* variables) const {
+  // Small programs don't need to touch the heap
+  static const std::size_t localDepth = 64;
+
+  const Entry& entry = entries_[index];
+  const OpCode* code = code_ + entry.code;
+
+  if (entry.stackDepth <= localDepth) {
+    OperandType stack[localDepth];
+    return evaluateProgram(code, code + entry.codeSize, constants_ + entry.constants, slots_ + entry.slots,
+			   variables, stack);
+  }
+
+  std::vector<OperandType> stack(entry.stackDepth);
+  return evaluateProgram(code, code + entry.codeSize, constants_ + entry.constants, slots_ + entry.slots,
+			 variables, stack.data());
+}
+
+std::string ExpressionLibrary::getVariableName(const std::size_t index, const std::size_t variable) const {
+  const char* name = names_ + entries_[index].names;
+  for (std::size_t k = 0; k < variable; ++k)
+    name+= std::strlen(name) + 1;
+
+  return name;
+}
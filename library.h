@@ -0,0 +1,138 @@
+#ifndef __LIBRARY_H__
+#define __LIBRARY_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "bytecode.h"
+#include "prepared.h"
+
+/* A file of compiled expressions. After the header come the entries,
+   the constant pool, the variable slots, the code and the variable
+   names, each a single array shared by all the expressions:
+
+     magic "CALCLIB", version, byte order marker, counts and sizes,
+     FNV-1a checksum over the 64-bit words past the header
+
+   Every array starts at a multiple of eight bytes, padded with zeros.
+
+   Numbers are stored in the byte order of the machine that wrote them;
+   a file from a machine with another order is refused. */
+namespace LibraryFormat {
+
+const char magic[8] = { 'C', 'A', 'L', 'C', 'L', 'I', 'B', '\0' };
+const std::uint32_t version = 1;
+const std::uint32_t byteOrderMarker = 0x01020304;
+
+struct Header {
+  char magic[8];
+  std::uint32_t version;
+  std::uint32_t byteOrder;
+  std::uint64_t expressions;
+  std::uint64_t constants;
+  std::uint64_t slots;
+  std::uint64_t codeBytes;
+  std::uint64_t nameBytes;
+  std::uint64_t checksum;
+};
+
+// Offsets count elements of the corresponding array
+struct Entry {
+  std::uint64_t code;
+  std::uint64_t constants;
+  std::uint64_t slots;
+  std::uint64_t names;
+  std::uint32_t codeSize;
+  std::uint32_t stackDepth;
+  std::uint32_t variables;
+  std::uint32_t reserved;
+};
+
+class Checksum {
+public:
+  void update(const void* data, std::size_t size);
+
+  // Bytes short of a whole word count as padded with zeros
+  std::uint64_t get() const;
+
+private:
+  std::uint64_t state_ = 14695981039346656037ull;
+  unsigned char pending_[8];
+  std::size_t pendingSize_ = 0;
+};
+
+inline std::size_t padded(const std::size_t bytes) {
+  return (bytes + 7) & ~static_cast<std::size_t>(7);
+}
+
+}
+
+class LibraryWriter {
+public:
+  // Names of the variables by index, as the slots refer to them
+  void add(const CompiledExpression&, const std::vector<std::string>& variables = { });
+  void add(const PreparedExpression&);
+
+  // Throws std::system_error
+  void save(const std::string& path) const;
+
+  std::size_t size() const {
+    return entries_.size();
+  }
+
+private:
+  std::vector<LibraryFormat::Entry> entries_;
+  std::vector<OperandType> constants_;
+  std::vector<std::uint32_t> slots_;
+  std::vector<OpCode> code_;
+  std::string names_;
+};
+
+/* A library mapped into memory and evaluated right from the mapping:
+   opening costs the same for any number of expressions, apart from the
+   checks. With verify the checksum is compared and every program is
+   checked to stay within its arrays; without it the file is trusted,
+   only the header and the bounds of the arrays are checked. Throws
+   std::system_error when the file cannot be mapped and
+   std::runtime_error when it is not a valid library. */
+class ExpressionLibrary {
+public:
+  static ExpressionLibrary open(const std::string& path, const bool verify = true);
+
+  ExpressionLibrary(ExpressionLibrary&&);
+  ~ExpressionLibrary();
+  ExpressionLibrary(const ExpressionLibrary&) = delete;
+  ExpressionLibrary& operator=(const ExpressionLibrary&) = delete;
+
+  std::size_t size() const {
+    return header_->expressions;
+  }
+
+  // Variables are looked up by index in the given array
+  double evaluate(const std::size_t index, const OperandType* variables = nullptr) const;
+
+  std::size_t getVariableCount(const std::size_t index) const {
+    return entries_[index].variables;
+  }
+
+  std::string getVariableName(const std::size_t index, const std::size_t variable) const;
+
+private:
+  ExpressionLibrary() = default;
+
+  void verifyPrograms() const;
+
+  void* memory_ = nullptr;
+  std::size_t mappedSize_ = 0;
+
+  const LibraryFormat::Header* header_ = nullptr;
+  const LibraryFormat::Entry* entries_ = nullptr;
+  const OperandType* constants_ = nullptr;
+  const std::uint32_t* slots_ = nullptr;
+  const OpCode* code_ = nullptr;
+  const char* names_ = nullptr;
+};
+
+#endif
@@ -0,0 +1,466 @@
+#ifndef __LITERAL_H__
+#define __LITERAL_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+
+#include "decimal.h"
+
+/* Expressions fixed in the source code, parsed by the compiler. The
+   grammar is that of ExpressionParser, implicit multiplication and ','
+   for the decimal point included, and numbers are rounded the same way
+   as by decimalToDouble.
+
+     constexpr double ratio = Literal::evaluate("(1 + 2,5)/7");
+     const auto area = LITERAL_EXPRESSION("(a + b)h/2");
+     area(3, 4, 2.5);
+
+   The first form has no variables. The second is a functor of the
+   variables in the order they first appear; its tree is laid out in
+   types, so calling it is plain arithmetic. Either way a syntax error
+   is a compile error naming the problem. Header only, needs C++14. */
+
+namespace Literal {
+
+namespace Details {
+
+/* Not constexpr on purpose: the compiler names the one it could not
+   call. Outside of constant evaluation they throw. */
+inline void unexpectedOperator() { throw std::invalid_argument("Unexpected operator"); }
+inline void unexpectedOperand() { throw std::invalid_argument("Unexpected operand"); }
+inline void unexpectedExpressionEnd() { throw std::invalid_argument("Unexpected expression end"); }
+inline void unexpectedSymbol() { throw std::invalid_argument("Unexpected symbol"); }
+inline void badSymbols() { throw std::invalid_argument("Bad symbols"); }
+
+constexpr bool isDigit(const char c) {
+  return c >= '0' && c <= '9';
+}
+
+using Decimal::isDecimalPoint;
+
+constexpr bool isIdentifierStart(const char c) {
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+}
+
+constexpr bool isTerminal(const char c) {
+  return c == '\0' || c == '\n';
+}
+
+constexpr bool isSpace(const char c) {
+  return c == ' ' || c == '\t' || c == '\v' || c == '\f' || c == '\r';
+}
+
+constexpr std::size_t length(const char* text) {
+  std::size_t size = 0;
+  while (text[size])
+    ++size;
+
+  return size;
+}
+
+// No ldexp at compile time; exact as long as the result is, which rounding made sure of
+struct ScaleByHalving {
+  static constexpr double scale(double value, int exponent) {
+    for (; exponent > 0; --exponent)
+      value*= 2;
+    for (; exponent < 0; ++exponent)
+      value/= 2;
+
+    return value;
+  }
+};
+
+/* Recursive descent over the grammar of ExpressionParser: unary
+   operators bind tighter than '*' and '/', which bind tighter than '+'
+   and '-'; binary ones are left associative. The builder decides what
+   a parsed operand turns into. */
+template<typename Builder>
+class Parser {
+public:
+  using Value = typename Builder::Value;
+
+  constexpr Parser(const char* text, Builder& builder): cur_(text), builder_(builder) { }
+
+  constexpr Value parse() {
+    const Value result = parseSum();
+
+    if (*cur_ == ')')
+      unexpectedSymbol();
+    else if (*cur_ == '\n' && cur_[1])
+      unexpectedSymbol();
+    else if (!isTerminal(*cur_))
+      rejectOperand();
+
+    return result;
+  }
+
+private:
+  constexpr Value parseSum() {
+    Value result = parseProduct();
+
+    for (;;) {
+      const char c = *cur_;
+
+      if (c != '+' && c != '-')
+	return result;
+
+      ++cur_;
+      result = builder_.binary(c, result, parseProduct());
+    }
+  }
+
+  // Products end with the whitespace after them skipped
+  constexpr Value parseProduct() {
+    Value result = parseOperand();
+
+    for (;;) {
+      skipSpace();
+      const char c = *cur_;
+
+      if (c == '*' || c == '/') {
+	++cur_;
+	result = builder_.binary(c, result, parseOperand());
+      }
+      else if (c == '(' || (lastBlock_ && startsOperand(c)))
+	result = builder_.binary('*', result, parseOperand());
+      else
+	return result;
+    }
+  }
+
+  constexpr Value parseOperand() {
+    skipSpace();
+    const char c = *cur_;
+
+    if (c == '+' || c == '-') {
+      ++cur_;
+      const Value operand = parseOperand();
+      return c == '-' ? builder_.negate(operand) : operand;
+    }
+
+    if (c == '(') {
+      ++cur_;
+      const Value result = parseSum();
+
+      if (*cur_ != ')')
+	isTerminal(*cur_) ? unexpectedExpressionEnd() : rejectOperand();
+
+      ++cur_;
+      lastBlock_ = true;
+      return result;
+    }
+
+    if (isDigit(c) || isDecimalPoint(c)) {
+      lastBlock_ = false;
+      return builder_.constant(readNumber());
+    }
+
+    if (Builder::hasVariables && isIdentifierStart(c)) {
+      const char* begin = cur_;
+      while (isIdentifierStart(*cur_) || isDigit(*cur_))
+	++cur_;
+
+      lastBlock_ = false;
+      return builder_.variable(begin, cur_);
+    }
+
+    if (c == '*' || c == '/')
+      unexpectedOperator();
+    else if (isTerminal(c) || c == ')')
+      unexpectedExpressionEnd();
+    else
+      badSymbols();
+
+    return builder_.constant(0);
+  }
+
+  constexpr double readNumber() {
+    const char* begin = cur_;
+    bool hasDecPoint = false;
+
+    for (; isDigit(*cur_) || isDecimalPoint(*cur_); ++cur_)
+      if (isDecimalPoint(*cur_)) {
+	if (hasDecPoint)
+	  unexpectedSymbol();
+	hasDecPoint = true;
+      }
+
+    // Forbid .
+    if (hasDecPoint && cur_ - begin == 1)
+      unexpectedSymbol();
+
+    return Decimal::convert<ScaleByHalving>(begin, cur_);
+  }
+
+  // Whatever stands where an operator or the end should be
+  constexpr void rejectOperand() const {
+    if (startsOperand(*cur_))
+      unexpectedOperand();
+    else
+      badSymbols();
+  }
+
+  constexpr static bool startsOperand(const char c) {
+    return isDigit(c) || isDecimalPoint(c) || (Builder::hasVariables && isIdentifierStart(c));
+  }
+
+  constexpr void skipSpace() {
+    while (isSpace(*cur_))
+      ++cur_;
+  }
+
+  const char* cur_;
+  Builder& builder_;
+  // Whether the last operand read ended with ')'
+  bool lastBlock_ = false;
+};
+
+struct Calculator {
+  using Value = double;
+  static const bool hasVariables = false;
+
+  constexpr double constant(const double value) const {
+    return value;
+  }
+
+  constexpr double variable(const char*, const char*) const {
+    return 0;
+  }
+
+  constexpr double negate(const double value) const {
+    return -value;
+  }
+
+  constexpr double binary(const char op, const double lhs, const double rhs) const {
+    switch (op) {
+    case '+': return lhs + rhs;
+    case '-': return lhs - rhs;
+    case '*': return lhs * rhs;
+    default: return lhs / rhs;
+    }
+  }
+};
+
+enum class NodeKind {
+  Constant,
+  Variable,
+  Negate,
+  Add,
+  Subtract,
+  Multiply,
+  Divide
+};
+
+struct Node {
+  NodeKind kind = NodeKind::Constant;
+  double value = 0;
+  std::size_t index = 0;
+  std::size_t left = 0;
+  std::size_t right = 0;
+};
+
+// Every node but the implicit products takes a character of its own
+template<std::size_t Capacity>
+struct Tree {
+  Node nodes[Capacity];
+  std::size_t size = 0;
+  std::size_t root = 0;
+  std::size_t variableCount = 0;
+};
+
+template<std::size_t Capacity>
+class TreeBuilder {
+public:
+  using Value = std::size_t;
+  static const bool hasVariables = true;
+
+  constexpr explicit TreeBuilder(Tree<Capacity>& tree): tree_(tree) { }
+
+  constexpr std::size_t constant(const double value) {
+    Node& node = add(NodeKind::Constant);
+    node.value = value;
+    return tree_.size - 1;
+  }
+
+  // Numbered in the order they first appear, as by VariableTable
+  constexpr std::size_t variable(const char* begin, const char* end) {
+    std::size_t index = 0;
+    while (index < tree_.variableCount && !sameName(index, begin, end))
+      ++index;
+
+    if (index == tree_.variableCount) {
+      names_[index] = begin;
+      nameEnds_[index] = end;
+      ++tree_.variableCount;
+    }
+
+    Node& node = add(NodeKind::Variable);
+    node.index = index;
+    return tree_.size - 1;
+  }
+
+  constexpr std::size_t negate(const std::size_t operand) {
+    Node& node = add(NodeKind::Negate);
+    node.left = operand;
+    return tree_.size - 1;
+  }
+
+  constexpr std::size_t binary(const char op, const std::size_t lhs, const std::size_t rhs) {
+    Node& node = add(op == '+' ? NodeKind::Add : op == '-' ? NodeKind::Subtract :
+		     op == '*' ? NodeKind::Multiply : NodeKind::Divide);
+    node.left = lhs;
+    node.right = rhs;
+    return tree_.size - 1;
+  }
+
+private:
+  constexpr Node& add(const NodeKind kind) {
+    Node& node = tree_.nodes[tree_.size++];
+    node.kind = kind;
+    return node;
+  }
+
+  constexpr bool sameName(const std::size_t index, const char* begin, const char* end) const {
+    if (nameEnds_[index] - names_[index] != end - begin)
+      return false;
+
+    for (const char* name = names_[index]; begin != end; ++name, ++begin)
+      if (*name != *begin)
+	return false;
+
+    return true;
+  }
+
+  Tree<Capacity>& tree_;
+  const char* names_[Capacity] = { };
+  const char* nameEnds_[Capacity] = { };
+};
+
+template<std::size_t Capacity>
+constexpr Tree<Capacity> parseTree(const char* text) {
+  Tree<Capacity> tree;
+  TreeBuilder<Capacity> builder(tree);
+
+  tree.root = Parser<TreeBuilder<Capacity>>(text, builder).parse();
+  return tree;
+}
+
+// Source supplies the text through a static constexpr get()
+template<typename Source>
+struct Compiled {
+  static constexpr std::size_t capacity = 2 * length(Source::get()) + 1;
+  static constexpr Tree<capacity> tree = parseTree<capacity>(Source::get());
+};
+
+template<typename Source>
+constexpr Tree<Compiled<Source>::capacity> Compiled<Source>::tree;
+
+template<typename Source, std::size_t Index, NodeKind Kind = Compiled<Source>::tree.nodes[Index].kind>
+struct Evaluate;
+
+template<typename Source, std::size_t Index>
+struct Evaluate<Source, Index, NodeKind::Constant> {
+  static double apply(const double*) {
+    return Compiled<Source>::tree.nodes[Index].value;
+  }
+};
+
+template<typename Source, std::size_t Index>
+struct Evaluate<Source, Index, NodeKind::Variable> {
+  static double apply(const double* variables) {
+    return variables[Compiled<Source>::tree.nodes[Index].index];
+  }
+};
+
+template<typename Source, std::size_t Index>
+struct Evaluate<Source, Index, NodeKind::Negate> {
+  static double apply(const double* variables) {
+    return -Evaluate<Source, Compiled<Source>::tree.nodes[Index].left>::apply(variables);
+  }
+};
+
+template<typename Source, std::size_t Index, NodeKind Kind>
+struct EvaluateBinary {
+  static const std::size_t left = Compiled<Source>::tree.nodes[Index].left;
+  static const std::size_t right = Compiled<Source>::tree.nodes[Index].right;
+
+  static double lhs(const double* variables) {
+    return Evaluate<Source, left>::apply(variables);
+  }
+
+  static double rhs(const double* variables) {
+    return Evaluate<Source, right>::apply(variables);
+  }
+};
+
+template<typename Source, std::size_t Index>
+struct Evaluate<Source, Index, NodeKind::Add>: EvaluateBinary<Source, Index, NodeKind::Add> {
+  static double apply(const double* variables) {
+    return Evaluate::lhs(variables) + Evaluate::rhs(variables);
+  }
+};
+
+template<typename Source, std::size_t Index>
+struct Evaluate<Source, Index, NodeKind::Subtract>: EvaluateBinary<Source, Index, NodeKind::Subtract> {
+  static double apply(const double* variables) {
+    return Evaluate::lhs(variables) - Evaluate::rhs(variables);
+  }
+};
+
+template<typename Source, std::size_t Index>
+struct Evaluate<Source, Index, NodeKind::Multiply>: EvaluateBinary<Source, Index, NodeKind::Multiply> {
+  static double apply(const double* variables) {
+    return Evaluate::lhs(variables) * Evaluate::rhs(variables);
+  }
+};
+
+template<typename Source, std::size_t Index>
+struct Evaluate<Source, Index, NodeKind::Divide>: EvaluateBinary<Source, Index, NodeKind::Divide> {
+  static double apply(const double* variables) {
+    return Evaluate::lhs(variables) / Evaluate::rhs(variables);
+  }
+};
+
+}
+
+/* The value of a literal without variables. Only in a constant
+   expression is it computed at compile time; a division by zero there
+   does not compile either. */
+constexpr double evaluate(const char* text) {
+  Details::Calculator calculator;
+  return Details::Parser<Details::Calculator>(text, calculator).parse();
+}
+
+template<typename Source>
+class Expression {
+public:
+  static constexpr std::size_t variableCount = Details::Compiled<Source>::tree.variableCount;
+
+  // The values of the variables in the order they first appear
+  template<typename... Values>
+  double operator()(const Values... values) const {
+    static_assert(sizeof...(Values) == variableCount, "Every variable needs a value");
+
+    const double variables[] = { static_cast<double>(values)..., 0 };
+    return evaluate(variables);
+  }
+
+  double evaluate(const double* variables) const {
+    return Details::Evaluate<Source, Details::Compiled<Source>::tree.root>::apply(variables);
+  }
+};
+
+template<typename Source>
+constexpr std::size_t Expression<Source>::variableCount;
+
+}
+
+#define LITERAL_EXPRESSION(text) ([] {					\
+      struct Source {							\
+	static constexpr const char* get() { return text; }		\
+      };								\
+      return Literal::Expression<Source>();				\
+    }())
+
+#endif
@@ -0,0 +1,271 @@
+#include <cmath>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "optimizer.h"
+
+static bool isConstant(const TreeNode* node) {
+  return node->getKind() == NodeKind::Leaf;
+}
+
+static bool isConstant(const TreeNode* node, const OperandType value) {
+  return isConstant(node)
+    && static_cast<const Leaf*>(node)->getValue() == value
+    && std::signbit(static_cast<const Leaf*>(node)->getValue()) == std::signbit(value);
+}
+
+static bool isNegation(const TreeNode* node) {
+  return node->getKind() == NodeKind::Unary
+    && static_cast<const UnaryNode*>(node)->getOperator().getSymbol() == '-';
+}
+
+static OperandType valueOf(const TreeNode* node) {
+  return static_cast<const Leaf*>(node)->getValue();
+}
+
+static TreeNode* simplifyUnary(UnaryNode* node, TreeNode* child, NodeArena& arena, std::size_t& removed) {
+  const Operator& op = node->getOperator();
+
+  if (op.getSymbol() == '+') {
+    removed+= 1;
+    return child;
+  }
+
+  if (isConstant(child)) {
+    removed+= 1;
+    return arena.create<Leaf>(op(valueOf(child)));
+  }
+
+  if (isNegation(child)) {
+    removed+= 2;
+    return static_cast<UnaryNode*>(child)->getChild();
+  }
+
+  node->popChild();
+  node->addChild(child);
+  return node;
+}
+
+static TreeNode* simplifyBinary(BinaryNode* node, TreeNode* left, TreeNode* right,
+				NodeArena& arena, std::size_t& removed) {
+  const Operator& op = node->getOperator();
+
+  if (isConstant(left) && isConstant(right)) {
+    removed+= 2;
+    return arena.create<Leaf>(op(valueOf(left), valueOf(right)));
+  }
+
+  switch (op.getSymbol()) {
+  case '*':
+    if (isConstant(right, 1)) {
+      removed+= 2;
+      return left;
+    }
+    if (isConstant(left, 1)) {
+      removed+= 2;
+      return right;
+    }
+    break;
+
+  case '/':
+    if (isConstant(right, 1)) {
+      removed+= 2;
+      return left;
+    }
+    break;
+
+  case '+':
+    if (isConstant(right, -0.0)) {
+      removed+= 2;
+      return left;
+    }
+    if (isConstant(left, -0.0)) {
+      removed+= 2;
+      return right;
+    }
+    break;
+
+  case '-':
+    if (isConstant(right, 0.0)) {
+      removed+= 2;
+      return left;
+    }
+    break;
+  }
+
+  node->popChild();
+  node->popChild();
+  node->addChild(left);
+  node->addChild(right);
+  return node;
+}
+
+std::size_t simplifyTree(EvaluationTree& tree) {
+  // Removed nodes must not stay the insertion point
+  while (!tree.rootReached())
+    tree.ascend();
+
+  RootNode* root = static_cast<RootNode*>(tree.getRoot());
+  if (!root->filled())
+    return 0;
+
+  NodeArena& arena = tree.getArena();
+  std::size_t removed = 0;
+
+  /* Post-order walk with an explicit stack: the flag tells whether the
+     node's children have already been simplified, their replacements
+     wait on the results stack. */
+  std::vector<std::pair<TreeNode*, bool>> pending;
+  std::vector<TreeNode*> results;
+  pending.emplace_back(root->getChild(), false);
+
+  while (!pending.empty()) {
+    TreeNode* node = pending.back().first;
+    const bool childrenDone = pending.back().second;
+    pending.pop_back();
+
+    switch (node->getKind()) {
+    case NodeKind::Unary: {
+      UnaryNode* unary = static_cast<UnaryNode*>(node);
+
+      if (!childrenDone) {
+	if (!unary->filled())
+	  throw std::runtime_error("Simplifying unary node without an operand");
+
+	pending.emplace_back(node, true);
+	pending.emplace_back(unary->getChild(), false);
+      }
+      else {
+	TreeNode* child = results.back();
+	results.back() = simplifyUnary(unary, child, arena, removed);
+      }
+      break;
+    }
+
+    case NodeKind::Binary: {
+      BinaryNode* binary = static_cast<BinaryNode*>(node);
+
+      if (!childrenDone) {
+	if (!binary->filled())
+	  throw std::runtime_error("Simplifying binary node without operand(s)");
+
+	pending.emplace_back(node, true);
+	pending.emplace_back(binary->getRightChild(), false);
+	pending.emplace_back(binary->getLeftChild(), false);
+      }
+      else {
+	TreeNode* right = results.back();
+	results.pop_back();
+	TreeNode* left = results.back();
+	results.back() = simplifyBinary(binary, left, right, arena, removed);
+      }
+      break;
+    }
+
+    default:
+      results.push_back(node);
+    }
+  }
+
+  root->popChild();
+  root->addChild(results.back());
+
+  return removed;
+}
+
+// The chain's own nodes are reused, in preorder, so the first stays on top
+static TreeNode* buildBalanced(const std::vector<TreeNode*>& links, std::size_t& next,
+			       const std::vector<TreeNode*>& operands, const std::size_t first, const std::size_t last) {
+  if (first == last)
+    return operands[first];
+
+  const std::size_t middle = first + (last - first) / 2;
+  TreeNode* node = links[next++];
+  node->addChild(buildBalanced(links, next, operands, first, middle));
+  node->addChild(buildBalanced(links, next, operands, middle + 1, last));
+  return node;
+}
+
+static bool continuesChain(const TreeNode* node, const char symbol) {
+  return node->getKind() == NodeKind::Binary
+    && static_cast<const BinaryNode*>(node)->getOperator().getSymbol() == symbol;
+}
+
+std::size_t balanceChains(EvaluationTree& tree) {
+  while (!tree.rootReached())
+    tree.ascend();
+
+  RootNode* root = static_cast<RootNode*>(tree.getRoot());
+  if (!root->filled())
+    return 0;
+
+  std::size_t balanced = 0;
+  std::vector<TreeNode*> pending(1, root->getChild());
+  std::vector<TreeNode*> links, operands, walk;
+
+  while (!pending.empty()) {
+    TreeNode* node = pending.back();
+    pending.pop_back();
+
+    if (node->getKind() == NodeKind::Unary || node->getKind() == NodeKind::Group) {
+      if (!node->filled())
+	throw std::runtime_error("Balancing an incomplete tree");
+
+      pending.push_back(node->getKind() == NodeKind::Unary ? static_cast<UnaryNode*>(node)->getChild()
+			: static_cast<GroupNode*>(node)->getChild());
+      continue;
+    }
+
+    if (node->getKind() != NodeKind::Binary)
+      continue;
+
+    BinaryNode* binary = static_cast<BinaryNode*>(node);
+    const char symbol = binary->getOperator().getSymbol();
+    if (!binary->filled())
+      throw std::runtime_error("Balancing an incomplete tree");
+
+    if (symbol != '+' && symbol != '*') {
+      pending.push_back(binary->getRightChild());
+      pending.push_back(binary->getLeftChild());
+      continue;
+    }
+
+    // The operands of the whole chain from left to right
+    links.clear();
+    operands.clear();
+    walk.assign(1, node);
+
+    while (!walk.empty()) {
+      TreeNode* link = walk.back();
+      walk.pop_back();
+
+      if (!continuesChain(link, symbol)) {
+	operands.push_back(link);
+	continue;
+      }
+
+      if (!link->filled())
+	throw std::runtime_error("Balancing an incomplete tree");
+
+      links.push_back(link);
+      walk.push_back(static_cast<BinaryNode*>(link)->getRightChild());
+      walk.push_back(static_cast<BinaryNode*>(link)->getLeftChild());
+    }
+
+    if (operands.size() > 2) {
+      for (TreeNode* link : links) {
+	link->popChild();
+	link->popChild();
+      }
+
+      std::size_t next = 0;
+      buildBalanced(links, next, operands, 0, operands.size() - 1);
+      ++balanced;
+    }
+
+    pending.insert(pending.end(), operands.rbegin(), operands.rend());
+  }
+
+  return balanced;
+}
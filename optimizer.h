@@ -0,0 +1,29 @@
+#ifndef __OPTIMIZER_H__
+#define __OPTIMIZER_H__
+
+#include <cstddef>
+
+#include "tree.h"
+
+/* Rewrites a complete tree in place without changing its value in any
+   bit: folds constant subtrees, drops unary pluses and double
+   negations, removes multiplications and divisions by one. Additions
+   of zero stay, as -0 + 0 is +0, and so does x - -y, as it keeps the
+   sign of a NaN y while x + y does not. New nodes come from the tree's
+   arena. Returns the number of nodes removed. */
+std::size_t simplifyTree(EvaluationTree&);
+
+/* Regroups chains of additions and of multiplications, which the
+   parser builds left-deep, into balanced trees, so that their halves
+   can be evaluated in parallel. The operands keep their order, only
+   the parentheses move: ((a + b) + c) + d becomes (a + b) + (c + d).
+   Floating-point arithmetic is not associative, so the result may
+   differ in the last bits: the rounding errors of a balanced sum of n
+   terms grow with log n rather than n, and an intermediate overflow
+   may turn up or go away. Not for when the exact result of the
+   original order matters, hence never done by default. A chain ends
+   at another operator, so a - b + c is two chains. Returns the number
+   of chains regrouped. */
+std::size_t balanceChains(EvaluationTree&);
+
+#endif
@@ -0,0 +1,38 @@
+#include <cstring>
+
+#include "output.h"
+
+OutputBuffer::OutputBuffer(std::ostream& stream, const std::size_t capacity): stream_(stream), buffer_(capacity ? capacity : 1) { }
+
+OutputBuffer::~OutputBuffer() {
+  flush();
+}
+
+void OutputBuffer::write(const char* data, const std::size_t length) {
+  if (length_ + length > buffer_.size()) {
+    flush();
+
+    // Too long to buffer at all
+    if (length > buffer_.size()) {
+      stream_.write(data, length);
+      return;
+    }
+  }
+
+  std::memcpy(buffer_.data() + length_, data, length);
+  length_+= length;
+}
+
+void OutputBuffer::writeLine(const char* data, const std::size_t length) {
+  write(data, length);
+  write("\n", 1);
+}
+
+void OutputBuffer::flush() {
+  if (length_) {
+    stream_.write(buffer_.data(), length_);
+    length_ = 0;
+  }
+
+  stream_.flush();
+}
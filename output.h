@@ -0,0 +1,34 @@
+#ifndef __OUTPUT_H__
+#define __OUTPUT_H__
+
+#include <cstddef>
+#include <iostream>
+#include <vector>
+
+/* Collects output in a big buffer and hands it to the stream in one
+   write. Nothing is flushed implicitly but on overflow and on
+   destruction: the owner decides where the batch boundaries are. */
+class OutputBuffer {
+public:
+  explicit OutputBuffer(std::ostream&, const std::size_t capacity = 64 * 1024);
+  ~OutputBuffer();
+  OutputBuffer(const OutputBuffer&) = delete;
+  OutputBuffer& operator=(const OutputBuffer&) = delete;
+
+  void write(const char* data, const std::size_t length);
+  // Appends a line break, as std::endl would but without the flush
+  void writeLine(const char* data, const std::size_t length);
+
+  void flush();
+
+  std::size_t getPending() const {
+    return length_;
+  }
+
+private:
+  std::ostream& stream_;
+  std::vector<char> buffer_;
+  std::size_t length_ = 0;
+};
+
+#endif
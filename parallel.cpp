@@ -0,0 +1,175 @@
+#include <stdexcept>
+#include <utility>
+
+#include "parallel.h"
+
+namespace {
+
+const TreeNode* firstChild(const TreeNode* node) {
+  if (node->getKind() == NodeKind::Leaf || node->getKind() == NodeKind::Variable)
+    return nullptr;
+  if (!node->filled())
+    throw std::runtime_error("Splitting an incomplete tree");
+
+  switch (node->getKind()) {
+  case NodeKind::Root: return static_cast<const RootNode*>(node)->getChild();
+  case NodeKind::Group: return static_cast<const GroupNode*>(node)->getChild();
+  case NodeKind::Unary: return static_cast<const UnaryNode*>(node)->getChild();
+  default: return static_cast<const BinaryNode*>(node)->getLeftChild();
+  }
+}
+
+double valueOf(const TreeNode* node) {
+  return node->isDirty() ? node->evaluate() : node->getCachedValue();
+}
+
+// What the plan knows of a subtree while it is being cut
+struct Summary {
+  std::size_t size;
+  // The lowest node of the spine, for subtrees large enough to have one
+  const TreeNode* bottom;
+  std::vector<std::pair<const TreeNode*, std::size_t>> forks;
+};
+
+}
+
+ParallelEvaluation::ParallelEvaluation(const EvaluationTree& tree, const std::size_t cutoff): tree_(tree) {
+  const TreeNode* top = tree.getRoot();
+
+  auto finish = [this](const TreeNode* node, const Summary& summary) {
+    spines_.push_back({ node, summary.bottom, forks_.size(), summary.forks.size() });
+    for (const auto& fork : summary.forks)
+      forks_.push_back({ fork.first, fork.second });
+
+    return spines_.size() - 1;
+  };
+
+  // The larger child continues the spine of its parent
+  auto join = [&](const TreeNode* parent, Summary& heavy, Summary* light, const TreeNode* lightNode) {
+    Summary result = { heavy.size + (light ? light->size : 0) + 1, nullptr, { } };
+    if (result.size < cutoff)
+      return result;
+
+    result.forks = std::move(heavy.forks);
+    result.bottom = heavy.size >= cutoff ? heavy.bottom : parent;
+
+    if (light && light->size >= cutoff)
+      result.forks.emplace_back(parent, finish(lightNode, *light));
+
+    return result;
+  };
+
+  /* Post-order walk along the parent links as in the evaluation, with
+     the summaries of left subtrees waiting for their right siblings */
+  std::vector<Summary> pending;
+  const TreeNode* node = top;
+
+  for (;;) {
+    while (const TreeNode* child = firstChild(node))
+      node = child;
+
+    Summary summary = { 1, nullptr, { } };
+
+    for (;;) {
+      if (node == top) {
+	if (summary.size >= cutoff)
+	  finish(top, summary);
+
+	results_.resize(spines_.size());
+	done_.reset(new std::atomic<bool>[spines_.size()]);
+	return;
+      }
+
+      const TreeNode* parent = node->getParent();
+
+      if (parent->getKind() == NodeKind::Binary) {
+	const BinaryNode* binary = static_cast<const BinaryNode*>(parent);
+
+	if (node == binary->getLeftChild()) {
+	  pending.push_back(std::move(summary));
+	  node = binary->getRightChild();
+	  break;
+	}
+
+	Summary left = std::move(pending.back());
+	pending.pop_back();
+
+	if (left.size >= summary.size)
+	  summary = join(parent, left, &summary, node);
+	else
+	  summary = join(parent, summary, &left, binary->getLeftChild());
+      }
+      else
+	summary = join(parent, summary, nullptr, nullptr);
+
+      node = parent;
+    }
+  }
+}
+
+double ParallelEvaluation::evaluate(WorkStealingPool& pool) {
+  if (spines_.empty())
+    return tree_.evaluate();
+
+  return evaluateSpine(pool, spines_.size() - 1);
+}
+
+double ParallelEvaluation::evaluateSpine(WorkStealingPool& pool, const std::size_t index) {
+  const Spine& spine = spines_[index];
+  if (!spine.top->isDirty())
+    return spine.top->getCachedValue();
+
+  // The upper forks are the larger ones, they go first for the thieves
+  for (std::size_t i = spine.forkCount; i-- > 0;) {
+    const Fork& fork = forks_[spine.firstFork + i];
+    const TreeNode* light = spines_[fork.spine].top;
+
+    if (!light->isDirty()) {
+      results_[fork.spine] = light->getCachedValue();
+      done_[fork.spine].store(true, std::memory_order_relaxed);
+      continue;
+    }
+
+    done_[fork.spine].store(false, std::memory_order_relaxed);
+    const std::size_t forked = fork.spine;
+    pool.spawn([this, &pool, forked]() {
+	results_[forked] = evaluateSpine(pool, forked);
+	done_[forked].store(true, std::memory_order_release);
+      });
+  }
+
+  double value = valueOf(spine.bottom);
+  bool dirty = spine.bottom->isDirty();
+
+  const TreeNode* node = spine.bottom;
+  std::size_t next = spine.firstFork;
+
+  while (node != spine.top) {
+    const TreeNode* parent = node->getParent();
+
+    if (parent->getKind() == NodeKind::Unary)
+      value = static_cast<const UnaryNode*>(parent)->getOperator()(value);
+    else if (parent->getKind() == NodeKind::Binary) {
+      const BinaryNode* binary = static_cast<const BinaryNode*>(parent);
+      const bool fromLeft = node == binary->getLeftChild();
+      const TreeNode* light = fromLeft ? binary->getRightChild() : binary->getLeftChild();
+
+      double lightValue;
+      if (next < spine.firstFork + spine.forkCount && forks_[next].node == parent) {
+	pool.waitFor(done_[forks_[next].spine]);
+	lightValue = results_[forks_[next].spine];
+	++next;
+      }
+      else
+	lightValue = valueOf(light);
+
+      value = fromLeft ? binary->getOperator()(value, lightValue) : binary->getOperator()(lightValue, value);
+      dirty = dirty || light->isDirty();
+    }
+
+    parent->setCachedValue(value, dirty);
+    node = parent;
+  }
+
+  return value;
+}
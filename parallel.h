@@ -0,0 +1,62 @@
+#ifndef __PARALLEL_H__
+#define __PARALLEL_H__
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+#include "pool.h"
+#include "tree.h"
+
+/* Evaluation of one large tree on a work-stealing pool. The tree is
+   cut once into spines: a spine runs from a node down through the
+   larger child for as long as that child holds at least `cutoff`
+   nodes. Smaller subtrees hanging off a spine are evaluated serially
+   on the way back up, larger ones make spines of their own which are
+   spawned as tasks. The result matches EvaluationTree::evaluate() bit
+   for bit and the cached values are kept up to date, so that clean
+   subtrees are skipped next time.
+
+   A left-deep chain such as 1+2+...+n is a single spine and gains
+   nothing: see balanceChains() in optimizer.h. The plan refers to the
+   nodes, so the tree may have its leaves and variables changed but
+   not its shape. Not to be run from several threads at once. */
+class ParallelEvaluation {
+public:
+  ParallelEvaluation(const EvaluationTree&, const std::size_t cutoff = 4096);
+
+  double evaluate(WorkStealingPool&);
+
+  // Tasks one evaluation spawns at most, besides the caller's own spine
+  std::size_t getTaskCount() const {
+    return spines_.size() ? spines_.size() - 1 : 0;
+  }
+
+private:
+  // A spine's light child which is a spine of its own
+  struct Fork {
+    const TreeNode* node;
+    std::size_t spine;
+  };
+
+  // Forks are listed from the bottom up
+  struct Spine {
+    const TreeNode* top;
+    const TreeNode* bottom;
+    std::size_t firstFork;
+    std::size_t forkCount;
+  };
+
+  double evaluateSpine(WorkStealingPool&, const std::size_t);
+
+  const EvaluationTree& tree_;
+
+  std::vector<Spine> spines_;
+  std::vector<Fork> forks_;
+
+  std::vector<double> results_;
+  std::unique_ptr<std::atomic<bool>[]> done_;
+};
+
+#endif
@@ -1,136 +1,81 @@
-#include <cstdlib>
 #include <iostream>
+#include <string>
 
 #include "parser.h"
-#include "exceptions.h"
+#include "reader.h"
 
-ExpressionParser ExpressionParser::parseStream(std::istream& stream) {
-  ExpressionParser parser(stream);
-
-  // Garbage left?
-  const char c = stream.get();
-
-  if (!ExpressionParser::isTerminal(c)) {
-    auto up = Exceptions::UnexpectedSymbol(c);
-    up.movePos(parser.getCharsRead() + 1);
-    throw up;
-  }
-
-  return parser;
+ExpressionParser ExpressionParser::parseBuffer(const char* begin, const char* end) {
+  return ExpressionParser(begin, end);
 }
 
-void ExpressionParser::parse() {
-  while (stream_.good() && !exprEndReached_) {    
-    try {
-      parseNext();
-
-      if (exprEndReached_ && !result_.isReady())
-	throw Exceptions::UnexpectedExpressionEnd();
-    }
-    catch (Exceptions::ParsingException& e) {
-      e.movePos(getCharsRead());
-      throw;
-    }
-  }
+ExpressionParser ExpressionParser::parseBuffer(const char* begin, const char* end, NodeArena& arena) {
+  return ExpressionParser(begin, end, arena);
 }
 
-bool ExpressionParser::isTerminal(char c) {
-  return c == EOF || c == '\n';
+ExpressionParser ExpressionParser::parseBuffer(const char* begin, const char* end, VariableTable& variables) {
+  return ExpressionParser(begin, end, &variables);
 }
 
-bool ExpressionParser::isDecimalPoint(char c) {
-  return c == '.' || c == ',';
-}
+ExpressionParser ExpressionParser::parseStream(std::istream& stream) {
+  std::string line;
+  readLine(stream, line);
 
-void ExpressionParser::parseNext() {
-  const char c = stream_.peek();
+  return parseBuffer(line.data(), line.data() + line.size());
+}
 
-  if (isTerminal(c) || c == ')') {
-    exprEndReached_ = true;
-    return;
-  }
+ExpressionParser ExpressionParser::parseStream(std::istream& stream, NodeArena& arena) {
+  std::string line;
+  readLine(stream, line);
 
-  if (std::isspace(c)) // Ignore whitespace
-    readNextChar();
-  else if (std::isdigit(c) || isDecimalPoint(c)) {
-    if (lastRead_ == TokenType::Block)
-      result_.insertOperator('*');
+  return parseBuffer(line.data(), line.data() + line.size(), arena);
+}
 
-    result_.insertOperand(readDouble());
-    lastRead_ = TokenType::Operand;
-  }
-  else if (c == '+' || c == '-' || c == '*' || c == '/') {
-    result_.insertOperator(readNextChar());
-    lastRead_ = TokenType::Operator;
-  }
-  else if (c == '(') {
-    readNextChar();
+bool ExpressionParser::readLine(std::istream& stream, std::string& line) {
+  std::getline(stream, line);
+  if (stream.fail())
+    return false;
 
-    if (lastRead_ == TokenType::Operand || lastRead_ == TokenType::Block)
-      result_.insertOperator('*');
+  if (!stream.eof())
+    line.push_back('\n');
 
-    ExpressionParser recParser(stream_);
-    charsRead_+= recParser.getCharsRead();
+  return true;
+}
 
-    if (recParser.nothingRead())
-      throw Exceptions::UnexpectedExpressionEnd();
+namespace {
 
-    result_.insertSubTree(recParser.getTree());
-    lastRead_ = TokenType::Block;
+// Identifiers become variables, if there is a table to register them in
+class VariableLookup {
+public:
+  explicit VariableLookup(VariableTable* variables): variables_(variables) { }
 
-    if (!stream_.good() || readNextChar() != ')')
-      throw Exceptions::UnexpectedExpressionEnd();
+  bool accepted() const {
+    return variables_;
   }
-  else
-    throw Exceptions::BadSymbols(readBadSymbols());
-}
 
-double ExpressionParser::readDouble() {
-  std::string dStr;
-  char c;
-  bool hasDecPoint = false;
-
-  while ((c = stream_.get())) {
-    if (isDecimalPoint(c)) {
-      if (hasDecPoint) {
-	++charsRead_;
-	throw Exceptions::UnexpectedSymbol(c);
-      }
-
-      hasDecPoint = true;
-      dStr.push_back('.');
-    }
-    else if (std::isdigit(c))
-      dStr.push_back(c);
-    else {
-      stream_.unget();
-      break;
-    }
-
-    ++charsRead_;
+  void insert(EvaluationTree& tree, const char* begin, const char* end) const {
+    tree.insertVariable(*variables_, variables_->lookup(std::string(begin, end)));
   }
 
-  // Forbid .
-  if (hasDecPoint && dStr.size() == 1)
-    throw Exceptions::UnexpectedSymbol(dStr[0]);
+private:
+  VariableTable* variables_;
+};
 
-  return std::atof(dStr.c_str());
 }
 
-std::string ExpressionParser::readBadSymbols() {
-  /* For some reason according to the ToR we're supposed to return the
-     whole line of bad symbols in the exception, not just the first
-     one. Well, whatever. */
-  static const std::string goodSymbols = " +-*/().,0123456789";
-  std::string badSymbols;
-
-  while (!isTerminal(stream_.peek()) && goodSymbols.find(stream_.peek()) == std::string::npos)
-    badSymbols.push_back(stream_.get()); // Do not increase counter
-  
-  return badSymbols;
+void ExpressionParser::parse(const char* begin, const char* end, VariableTable* variables) {
+  ExpressionReader<EvaluationTree, VariableLookup> reader(begin, end, result_, VariableLookup(variables));
+  reader.read();
+
+  cur_ = reader.getPosition();
+  charsRead_ = reader.getCharsRead();
+  nothingRead_ = reader.nothingRead();
 }
 
-char ExpressionParser::readNextChar() {
-  ++charsRead_;
-  return stream_.get();
+bool ExpressionParser::isTerminal(char c) {
+  return c == EOF || c == '\n';
+}
+
+bool ExpressionParser::isDecimalPoint(char c) {
+  return c == '.' || c == ',';
 }
+
@@ -1,6 +1,7 @@
 #ifndef __PARSER_H__
 #define __PARSER_H__
 #include <iostream>
+#include <string>
 
 #include "tree.h"
 
@@ -13,37 +14,51 @@ enum class TokenType {
 
 class ExpressionParser {
 public:
+  /* Parses a single expression from the range, reading up to and
+     including the terminating '\n'. The range is tokenized in place,
+     nothing is copied out of it. */
+  static ExpressionParser parseBuffer(const char* begin, const char* end);
+  static ExpressionParser parseBuffer(const char* begin, const char* end, NodeArena&);
+  // Identifiers are only accepted with a table to register them in
+  static ExpressionParser parseBuffer(const char* begin, const char* end, VariableTable&);
+
+  // Thin adapters over parseBuffer which consume one line of the stream
   static ExpressionParser parseStream(std::istream&);
+  static ExpressionParser parseStream(std::istream&, NodeArena&);
+
+  // Reads a line keeping its '\n' (if any) so that it may be parsed as is
+  static bool readLine(std::istream&, std::string&);
 
   EvaluationTree& getTree() { return result_; }
   std::size_t getCharsRead() const { return charsRead_; }
 
+  // Where the parsing stopped: past the expression and its terminator
+  const char* getPosition() const { return cur_; }
+
   bool nothingRead() const {
-    return lastRead_ == TokenType::Empty;
+    return nothingRead_;
   }
 
   static bool isTerminal(const char);
   static bool isDecimalPoint(const char);
 
 private:
-  ExpressionParser(std::istream& s): stream_(s) {
-    parse();
+  // The grammar itself is ExpressionReader's (reader.h)
+  ExpressionParser(const char* begin, const char* end, VariableTable* variables = nullptr) {
+    parse(begin, end, variables);
   }
 
-  void parse();
-  void parseNext();
-
-  double readDouble();
-  std::string readBadSymbols();
-
-  char readNextChar();
+  ExpressionParser(const char* begin, const char* end, NodeArena& arena, VariableTable* variables = nullptr):
+    result_(arena) {
+    parse(begin, end, variables);
+  }
 
-  std::istream& stream_;
+  void parse(const char* begin, const char* end, VariableTable* variables);
 
+  const char* cur_ = nullptr;
   std::size_t charsRead_ = 0;
-  bool exprEndReached_ = false;
-  TokenType lastRead_ = TokenType::Empty;
-  
+  bool nothingRead_ = true;
+
   EvaluationTree result_;
 };
 
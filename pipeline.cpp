@@ -0,0 +1,269 @@
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <memory>
+#include <sstream>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <time.h>
+#include <unistd.h>
+
+#include "batch.h"
+#include "pipeline.h"
+#include "queue.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Block {
+  std::string input;
+  std::vector<OutputSegment> output;
+  std::size_t lines = 0;
+  Clock::time_point readAt;
+  // Nothing follows
+  bool last = false;
+};
+
+using BlockQueue = SpscQueue<Block>;
+
+/* Lines wait in the queues for the blocks ahead of them, so the more
+   is queued the worse the latency under load; this keeps at most a
+   couple hundred kilobytes in flight */
+const std::size_t readSize = 16 * 1024;
+const std::size_t writeSize = 64 * 1024;
+const std::size_t queueCapacity = 4;
+
+}
+
+void LatencyHistogram::add(const std::uint64_t nanoseconds, const std::uint64_t count) {
+  std::size_t bucket = nanoseconds;
+
+  // The leading bit picks the power of two, the next three the eighth of it
+  if (nanoseconds >= subBuckets) {
+    const int exponent = 63 - __builtin_clzll(nanoseconds);
+    bucket = (exponent - 2) * subBuckets + ((nanoseconds >> (exponent - 3)) & (subBuckets - 1));
+  }
+
+  buckets_[bucket]+= count;
+  count_+= count;
+}
+
+std::uint64_t LatencyHistogram::percentile(const double percent) const {
+  const std::uint64_t rank = std::max<std::uint64_t>(1, static_cast<std::uint64_t>(percent / 100 * count_ + 0.5));
+  std::uint64_t seen = 0;
+
+  for (std::size_t bucket = 0; bucket < sizeof(buckets_) / sizeof(buckets_[0]); ++bucket) {
+    seen+= buckets_[bucket];
+    if (seen < rank)
+      continue;
+
+    if (bucket < subBuckets)
+      return bucket;
+
+    const int exponent = bucket / subBuckets + 2;
+    return ((subBuckets + 1 + bucket % subBuckets) << (exponent - 3)) - 1;
+  }
+
+  return 0;
+}
+
+std::string PipelineReport::summary() const {
+  std::ostringstream out;
+  out << std::fixed << std::setprecision(1)
+      << "конвейер: строк " << lines << " за " << wallTime * 1e3 << " мс, задержка строки, мкс: p50 "
+      << latency.percentile(50) / 1e3 << ", p99 " << latency.percentile(99) / 1e3 << "\n"
+      << "  процессорное время, % от общего: чтение " << readerTime / wallTime * 100
+      << ", вычисление " << evaluatorTime / wallTime * 100 << ", запись " << writerTime / wallTime * 100 << "\n";
+
+  return out.str();
+}
+
+static double threadCpuTime() {
+  timespec time;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time);
+  return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+// A failed write loses the rest of the output, as it would with the streams
+static void writeAll(const int fd, const char* data, std::size_t size) {
+  while (size) {
+    const ssize_t written = write(fd, data, size);
+
+    if (written < 0) {
+      if (errno == EINTR)
+	continue;
+      return;
+    }
+
+    data+= written;
+    size-= written;
+  }
+}
+
+static void readBlocks(const int in, std::vector<std::unique_ptr<BlockQueue>>& queues,
+		       Statistics* stats, double& cpuTime) {
+  std::string pending;
+  std::size_t next = 0;
+
+  for (;;) {
+    Block block;
+    block.input.swap(pending);
+
+    const std::size_t filled = block.input.size();
+    block.input.resize(filled + readSize);
+
+    ssize_t length;
+    {
+      PhaseTimer timer(stats, Statistics::ReadTime);
+      do
+	length = read(in, &block.input[filled], readSize);
+      while (length < 0 && errno == EINTR);
+    }
+
+    // An error ends the input, as it does for the streams
+    block.input.resize(filled + std::max<ssize_t>(length, 0));
+    if (stats && length > 0)
+      stats->add(Statistics::BytesRead, length);
+
+    // A partial line waits for the rest of it, unless the input is over
+    if (length > 0) {
+      const void* eol = memrchr(block.input.data() + filled, '\n', length);
+      if (!eol) {
+	pending.swap(block.input);
+	continue;
+      }
+
+      const std::size_t cut = static_cast<const char*>(eol) - block.input.data() + 1;
+      pending.assign(block.input, cut, std::string::npos);
+      block.input.resize(cut);
+    }
+
+    if (!block.input.empty()) {
+      block.lines = std::count(block.input.begin(), block.input.end(), '\n') + (block.input.back() != '\n');
+      block.readAt = Clock::now();
+      queues[next++ % queues.size()]->push(std::move(block));
+    }
+
+    if (length <= 0)
+      break;
+  }
+
+  for (auto& queue : queues) {
+    Block last;
+    last.last = true;
+    queue->push(std::move(last));
+  }
+
+  cpuTime = threadCpuTime();
+}
+
+static void evaluateBlocks(BlockQueue& input, BlockQueue& output, const std::size_t cacheCapacity,
+			   const std::size_t cacheBytes, Statistics* stats, double& cpuTime) {
+  LineEvaluator evaluator(cacheCapacity, cacheBytes);
+  evaluator.setStatistics(stats);
+
+  for (bool last = false; !last; ) {
+    Block block;
+    input.pop(block);
+    last = block.last;
+
+    if (!last) {
+      evaluateChunk(block.input.data(), block.input.data() + block.input.size(), evaluator, block.output);
+      std::string().swap(block.input);
+    }
+
+    output.push(std::move(block));
+  }
+
+  cpuTime = threadCpuTime();
+}
+
+static void writeBlocks(std::vector<std::unique_ptr<BlockQueue>>& queues, const int out, const int err,
+			PipelineReport& report) {
+  const double started = threadCpuTime();
+  std::string buffer;
+  std::vector<std::pair<Clock::time_point, std::size_t>> waiting;
+
+  // The lines of the blocks written out get their latencies
+  auto flush = [&]() {
+    writeAll(out, buffer.data(), buffer.size());
+    buffer.clear();
+
+    const Clock::time_point now = Clock::now();
+    for (const auto& block : waiting)
+      report.latency.add(std::chrono::duration_cast<std::chrono::nanoseconds>(now - block.first).count(),
+			 block.second);
+    waiting.clear();
+  };
+
+  for (std::size_t next = 0; ; ++next) {
+    BlockQueue& queue = *queues[next % queues.size()];
+    Block block;
+
+    if (!queue.tryPop(block)) {
+      flush();
+      queue.pop(block);
+    }
+
+    if (block.last)
+      break;
+
+    for (const auto& segment : block.output) {
+      if (segment.error) {
+	flush();
+	writeAll(err, segment.text.data(), segment.text.size());
+      }
+      else {
+	buffer+= segment.text;
+	if (buffer.size() >= writeSize) {
+	  writeAll(out, buffer.data(), buffer.size());
+	  buffer.clear();
+	}
+      }
+    }
+
+    report.lines+= block.lines;
+    waiting.emplace_back(block.readAt, block.lines);
+  }
+
+  flush();
+  report.writerTime = threadCpuTime() - started;
+}
+
+PipelineReport evaluatePipeline(const int in, const int out, const int err, const unsigned evaluators,
+				const std::size_t cacheCapacity, const std::size_t cacheBytes, Statistics* stats) {
+  const unsigned count = std::max(evaluators, 1u);
+  const Clock::time_point start = Clock::now();
+
+  std::vector<std::unique_ptr<BlockQueue>> inputs, outputs;
+  for (unsigned i = 0; i < count; ++i) {
+    inputs.emplace_back(new BlockQueue(queueCapacity));
+    outputs.emplace_back(new BlockQueue(queueCapacity));
+  }
+
+  PipelineReport report;
+  std::vector<double> evaluatorTimes(count);
+
+  std::vector<std::thread> threads;
+  threads.emplace_back(readBlocks, in, std::ref(inputs), stats, std::ref(report.readerTime));
+  for (unsigned i = 0; i < count; ++i)
+    threads.emplace_back(evaluateBlocks, std::ref(*inputs[i]), std::ref(*outputs[i]), cacheCapacity, cacheBytes,
+			 stats, std::ref(evaluatorTimes[i]));
+
+  // The writer stage is this thread
+  writeBlocks(outputs, out, err, report);
+
+  for (auto& thread : threads)
+    thread.join();
+
+  for (const double time : evaluatorTimes)
+    report.evaluatorTime+= time;
+  report.wallTime = std::chrono::duration<double>(Clock::now() - start).count();
+
+  return report;
+}
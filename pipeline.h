@@ -0,0 +1,55 @@
+#ifndef __PIPELINE_H__
+#define __PIPELINE_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "stats.h"
+
+/* Counts of nanosecond durations in buckets an eighth of a power of
+   two wide, so that percentiles come out within 12.5%. */
+class LatencyHistogram {
+public:
+  void add(const std::uint64_t nanoseconds, const std::uint64_t count = 1);
+
+  // The upper bound of the bucket the percentile falls into
+  std::uint64_t percentile(const double percent) const;
+
+  std::uint64_t getCount() const {
+    return count_;
+  }
+
+private:
+  static const int subBuckets = 8;
+
+  std::uint64_t buckets_[64 * subBuckets] = { };
+  std::uint64_t count_ = 0;
+};
+
+struct PipelineReport {
+  std::uint64_t lines = 0;
+  // Seconds of wall time and of CPU time of each stage
+  double wallTime = 0;
+  double readerTime = 0;
+  double evaluatorTime = 0;
+  double writerTime = 0;
+  // From the read() that brought a line in to the write() of its output
+  LatencyHistogram latency;
+
+  std::string summary() const;
+};
+
+/* calc's streaming mode. A reader thread read()s the input in big
+   blocks cut at line breaks and deals them in turn to the evaluator
+   threads; a writer thread collects the results in the same order and
+   write()s them out in big batches, as soon as it would otherwise have
+   to wait. The stages hand blocks over through bounded SPSC queues.
+   Results go to out and error messages to err, with out flushed first,
+   exactly as in the serial mode. Every evaluator gets a result cache
+   of its own if asked for. */
+PipelineReport evaluatePipeline(const int in, const int out, const int err, const unsigned evaluators,
+				const std::size_t cacheCapacity = 0, const std::size_t cacheBytes = 0,
+				Statistics* stats = nullptr);
+
+#endif
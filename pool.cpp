@@ -0,0 +1,116 @@
+#include <utility>
+
+#include "pool.h"
+#include "queue.h"
+
+namespace {
+
+// Which pool the thread works for, and its deque there
+thread_local const WorkStealingPool* ownPool = nullptr;
+thread_local std::size_t ownSlot = 0;
+
+}
+
+WorkStealingPool::WorkStealingPool(const std::size_t threads) {
+  const std::size_t count = threads ? threads : 1;
+
+  for (std::size_t i = 0; i < count; ++i)
+    deques_.emplace_back(new Deque());
+
+  for (std::size_t i = 1; i < count; ++i)
+    workers_.emplace_back(&WorkStealingPool::work, this, i);
+}
+
+WorkStealingPool::~WorkStealingPool() {
+  {
+    std::lock_guard<std::mutex> lock(sleepMutex_);
+    stop_ = true;
+  }
+  wakeUp_.notify_all();
+
+  for (auto& worker : workers_)
+    worker.join();
+}
+
+std::size_t WorkStealingPool::current() const {
+  return ownPool == this ? ownSlot : 0;
+}
+
+void WorkStealingPool::spawn(Task task) {
+  Deque& deque = *deques_[current()];
+  {
+    std::lock_guard<std::mutex> lock(deque.mutex);
+    deque.tasks.push_back(std::move(task));
+  }
+
+  // Either the sleeper sees the task queued or this sees the sleeper
+  ++queued_;
+  if (sleeping_.load()) {
+    std::lock_guard<std::mutex> lock(sleepMutex_);
+    wakeUp_.notify_one();
+  }
+}
+
+bool WorkStealingPool::take(const std::size_t self, Task& task) {
+  if (!queued_.load())
+    return false;
+
+  {
+    Deque& own = *deques_[self];
+    std::lock_guard<std::mutex> lock(own.mutex);
+
+    if (!own.tasks.empty()) {
+      task = std::move(own.tasks.back());
+      own.tasks.pop_back();
+      --queued_;
+      return true;
+    }
+  }
+
+  for (std::size_t i = 1; i < deques_.size(); ++i) {
+    Deque& victim = *deques_[(self + i) % deques_.size()];
+    std::lock_guard<std::mutex> lock(victim.mutex);
+
+    if (!victim.tasks.empty()) {
+      task = std::move(victim.tasks.front());
+      victim.tasks.pop_front();
+      --queued_;
+      ++steals_;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+void WorkStealingPool::waitFor(const std::atomic<bool>& done) {
+  const std::size_t self = current();
+  Backoff backoff;
+  Task task;
+
+  while (!done.load(std::memory_order_acquire))
+    if (take(self, task)) {
+      task();
+      backoff.reset();
+    }
+    else
+      backoff.pause();
+}
+
+void WorkStealingPool::work(const std::size_t self) {
+  ownPool = this;
+  ownSlot = self;
+  Task task;
+
+  while (!stop_) {
+    if (take(self, task)) {
+      task();
+      continue;
+    }
+
+    std::unique_lock<std::mutex> lock(sleepMutex_);
+    ++sleeping_;
+    wakeUp_.wait(lock, [this]() { return stop_ || queued_.load(); });
+    --sleeping_;
+  }
+}
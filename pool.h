@@ -0,0 +1,67 @@
+#ifndef __POOL_H__
+#define __POOL_H__
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/* Fork-join tasks on a fixed set of threads. Every thread has a deque
+   of its own: it pushes and takes its tasks at the back, most recent
+   first, while idle threads steal from the front, where the oldest and
+   usually largest tasks are. The thread which waits for a task keeps
+   running others meanwhile, so waiting never blocks a thread. Tasks
+   must not throw. */
+class WorkStealingPool {
+public:
+  using Task = std::function<void()>;
+
+  // The threads include the caller, which runs tasks while it waits
+  explicit WorkStealingPool(const std::size_t threads);
+  ~WorkStealingPool();
+  WorkStealingPool(const WorkStealingPool&) = delete;
+  WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+  // Queues the task on the current thread's deque
+  void spawn(Task);
+
+  // Runs tasks until the flag gets set by another one
+  void waitFor(const std::atomic<bool>& done);
+
+  std::size_t size() const {
+    return workers_.size() + 1;
+  }
+
+  std::size_t getSteals() const {
+    return steals_.load(std::memory_order_relaxed);
+  }
+
+private:
+  struct Deque {
+    std::mutex mutex;
+    std::deque<Task> tasks;
+  };
+
+  void work(const std::size_t self);
+  bool take(const std::size_t self, Task&);
+  std::size_t current() const;
+
+  // Slot 0 is shared by the threads outside the pool
+  std::vector<std::unique_ptr<Deque>> deques_;
+  std::vector<std::thread> workers_;
+
+  std::atomic<std::size_t> queued_{0};
+  std::atomic<std::size_t> sleeping_{0};
+  std::atomic<std::size_t> steals_{0};
+  std::atomic<bool> stop_{false};
+
+  std::mutex sleepMutex_;
+  std::condition_variable wakeUp_;
+};
+
+#endif
@@ -0,0 +1,25 @@
+#include <utility>
+
+#include "exceptions.h"
+#include "optimizer.h"
+#include "parser.h"
+#include "prepared.h"
+
+PreparedExpression::PreparedExpression(std::unique_ptr<VariableTable>&& variables, EvaluationTree&& tree):
+  variables_(std::move(variables)), tree_(std::move(tree)), program_(CompiledExpression::compile(tree_)) { }
+
+PreparedExpression PreparedExpression::prepare(const char* begin, const char* end) {
+  std::unique_ptr<VariableTable> variables(new VariableTable());
+  auto parser = ExpressionParser::parseBuffer(begin, end, *variables);
+
+  if (parser.nothingRead())
+    throw Exceptions::UnexpectedExpressionEnd();
+
+  simplifyTree(parser.getTree());
+
+  return PreparedExpression(std::move(variables), std::move(parser.getTree()));
+}
+
+PreparedExpression PreparedExpression::prepare(const std::string& expression) {
+  return prepare(expression.data(), expression.data() + expression.size());
+}
@@ -0,0 +1,68 @@
+#ifndef __PREPARED_H__
+#define __PREPARED_H__
+
+#include <cstddef>
+#include <memory>
+#include <string>
+
+#include "bytecode.h"
+#include "tree.h"
+
+/* An expression with named variables which is parsed, simplified and
+   compiled once and then evaluated against any number of bindings. */
+class PreparedExpression {
+public:
+  // Reads a single expression, up to the first line break
+  static PreparedExpression prepare(const char* begin, const char* end);
+  static PreparedExpression prepare(const std::string&);
+
+  std::size_t getVariableCount() const {
+    return variables_->size();
+  }
+
+  // Throws std::out_of_range for names absent from the expression
+  std::size_t getVariableIndex(const std::string& name) const {
+    return variables_->find(name);
+  }
+
+  const std::string& getVariableName(const std::size_t index) const {
+    return variables_->getName(index);
+  }
+
+  // Unbound variables are zero
+  void bind(const std::size_t index, const OperandType& value) {
+    variables_->bind(index, value);
+  }
+
+  double evaluate() const {
+    return program_.evaluate(variables_->getValues());
+  }
+
+  /* Evaluates every row of a column-major table: row i binds variable
+     k to columns[k][i]. The current bindings are left untouched. Rows
+     are processed in blocks with vector kernels, the results match
+     evaluate() bit for bit. */
+  void evaluateColumns(const OperandType* const* columns, const std::size_t rows,
+		       OperandType* results, const ColumnKernels& kernels = bestColumnKernels(),
+		       const std::size_t blockSize = 256) const {
+    program_.evaluateColumns(columns, rows, results, kernels, blockSize);
+  }
+
+  const EvaluationTree& getTree() const {
+    return tree_;
+  }
+
+  const CompiledExpression& getProgram() const {
+    return program_;
+  }
+
+private:
+  PreparedExpression(std::unique_ptr<VariableTable>&&, EvaluationTree&&);
+
+  // Variable nodes refer to the table, so it stays put on moves
+  std::unique_ptr<VariableTable> variables_;
+  EvaluationTree tree_;
+  CompiledExpression program_;
+};
+
+#endif
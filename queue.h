@@ -0,0 +1,122 @@
+#ifndef __QUEUE_H__
+#define __QUEUE_H__
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/* Waiting for another thread without a lock: spins first, then yields
+   and at last sleeps for up to a millisecond, so that an idle stage
+   does not hold a CPU. */
+class Backoff {
+public:
+  void pause() {
+    if (rounds_ < 64)
+      ;
+    else if (rounds_ < 128)
+      std::this_thread::yield();
+    else
+      std::this_thread::sleep_for(std::chrono::microseconds(1 << std::min(rounds_ - 128, 10)));
+
+    ++rounds_;
+  }
+
+  void reset() {
+    rounds_ = 0;
+  }
+
+private:
+  int rounds_ = 0;
+};
+
+/* Bounded lock-free queue between exactly one producer thread and one
+   consumer thread. Each side keeps its own index and a cached copy of
+   the other's, which it only reloads when the queue looks full (or
+   empty); the indices live on cache lines of their own. */
+template<typename T>
+class SpscQueue {
+public:
+  // The capacity is rounded up to a power of two
+  explicit SpscQueue(const std::size_t capacity): slots_(roundUp(capacity)), mask_(slots_.size() - 1) { }
+
+  SpscQueue(const SpscQueue&) = delete;
+  SpscQueue& operator=(const SpscQueue&) = delete;
+
+  // The value is only moved from on success
+  bool tryPush(T& value) {
+    const std::size_t tail = tail_.load(std::memory_order_relaxed);
+
+    if (tail - headCache_ == slots_.size()) {
+      headCache_ = head_.load(std::memory_order_acquire);
+      if (tail - headCache_ == slots_.size())
+	return false;
+    }
+
+    slots_[tail & mask_] = std::move(value);
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  bool tryPop(T& value) {
+    const std::size_t head = head_.load(std::memory_order_relaxed);
+
+    if (head == tailCache_) {
+      tailCache_ = tail_.load(std::memory_order_acquire);
+      if (head == tailCache_)
+	return false;
+    }
+
+    value = std::move(slots_[head & mask_]);
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  void push(T&& value) {
+    Backoff backoff;
+    while (!tryPush(value))
+      backoff.pause();
+  }
+
+  void pop(T& value) {
+    Backoff backoff;
+    while (!tryPop(value))
+      backoff.pause();
+  }
+
+  // Exact from the consumer's side only
+  bool empty() const {
+    return head_.load(std::memory_order_relaxed) == tail_.load(std::memory_order_acquire);
+  }
+
+private:
+  static std::size_t roundUp(const std::size_t capacity) {
+    std::size_t size = 1;
+    while (size < capacity)
+      size*= 2;
+
+    return size;
+  }
+
+  static const std::size_t cacheLine = 64;
+
+  std::vector<T> slots_;
+  const std::size_t mask_;
+
+  char padding0_[cacheLine];
+  // The consumer's side
+  std::atomic<std::size_t> head_{0};
+  std::size_t tailCache_ = 0;
+
+  char padding1_[cacheLine];
+  // The producer's side
+  std::atomic<std::size_t> tail_{0};
+  std::size_t headCache_ = 0;
+
+  char padding2_[cacheLine];
+};
+
+#endif
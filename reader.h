@@ -0,0 +1,335 @@
+#ifndef __READER_H__
+#define __READER_H__
+
+#include <cctype>
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "decimal.h"
+#include "exceptions.h"
+#include "parser.h"
+#include "tree.h"
+
+// Identifiers are bad symbols, as to a parser without variables
+struct NoIdentifiers {
+  bool accepted() const {
+    return false;
+  }
+
+  template <typename Builder>
+  void insert(Builder&, const char*, const char*) const { }
+};
+
+/* The grammar of calc: reads an expression and feeds its tokens to a
+   builder, throwing the parsing exceptions with their positions. The
+   builder takes insertOperand(), insertOperator(), openGroup() and
+   closeGroup() and answers isReady() and groupOpen() as EvaluationTree
+   does. Identifiers go to the hook if it accepted() them, with insert()
+   getting the builder and the identifier's characters. */
+template <typename Builder, typename Identifiers = NoIdentifiers>
+class ExpressionReader {
+public:
+  ExpressionReader(const char* begin, const char* end, Builder& builder,
+		   const Identifiers& identifiers = Identifiers()):
+    cur_(begin), end_(end), builder_(builder), identifiers_(identifiers) { }
+
+  // Reads the expression up to and including the terminating '\n'
+  void read() {
+    while (!exprEndReached_) {
+      try {
+	parseNext();
+
+	if (exprEndReached_ && !builder_.isReady())
+	  throw Exceptions::UnexpectedExpressionEnd();
+      }
+      catch (Exceptions::ParsingException& e) {
+	e.movePos(charsRead_);
+	throw;
+      }
+    }
+
+    checkGarbage();
+  }
+
+  bool nothingRead() const {
+    return lastRead_ == TokenType::Empty;
+  }
+
+  std::size_t getCharsRead() const {
+    return charsRead_;
+  }
+
+  // Past the expression and its terminator
+  const char* getPosition() const {
+    return cur_;
+  }
+
+private:
+  static bool isDigit(const char c) {
+    return c >= '0' && c <= '9';
+  }
+
+  static bool isIdentifierStart(const char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+  }
+
+  void checkGarbage() {
+    if (cur_ == end_)
+      return;
+
+    const char c = *cur_++;
+
+    if (!ExpressionParser::isTerminal(c)) {
+      auto up = Exceptions::UnexpectedSymbol(c);
+      up.movePos(charsRead_ + 1);
+      throw up;
+    }
+  }
+
+  void parseNext() {
+    if (terminalReached() || *cur_ == ')') {
+      if (builder_.groupOpen())
+	closeGroup();
+      else
+	exprEndReached_ = true;
+      return;
+    }
+
+    const char c = *cur_;
+
+    if (std::isspace(static_cast<unsigned char>(c))) // Ignore whitespace
+      readNextChar();
+    else if (isDigit(c) || ExpressionParser::isDecimalPoint(c)) {
+      if (lastRead_ == TokenType::Block)
+	builder_.insertOperator('*');
+
+      builder_.insertOperand(readDouble());
+      lastRead_ = TokenType::Operand;
+    }
+    else if (identifiers_.accepted() && isIdentifierStart(c)) {
+      if (lastRead_ == TokenType::Block)
+	builder_.insertOperator('*');
+
+      readIdentifier();
+      lastRead_ = TokenType::Operand;
+    }
+    else if (c == '+' || c == '-' || c == '*' || c == '/') {
+      builder_.insertOperator(readNextChar());
+      lastRead_ = TokenType::Operator;
+    }
+    else if (c == '(') {
+      readNextChar();
+
+      if (lastRead_ == TokenType::Operand || lastRead_ == TokenType::Block)
+	builder_.insertOperator('*');
+
+      // The contents start over as if they were a whole expression
+      builder_.openGroup();
+      lastRead_ = TokenType::Empty;
+    }
+    else
+      throw Exceptions::BadSymbols(readBadSymbols());
+  }
+
+  void closeGroup() {
+    // An empty or unfinished group is reported before its end
+    if (lastRead_ == TokenType::Empty || !builder_.isReady())
+      throw Exceptions::UnexpectedExpressionEnd();
+
+    if (cur_ == end_ || readNextChar() != ')')
+      throw Exceptions::UnexpectedExpressionEnd();
+
+    builder_.closeGroup();
+    lastRead_ = TokenType::Block;
+  }
+
+  double readDouble() {
+    const char* begin = cur_;
+    bool hasDecPoint = false;
+
+    for (; cur_ != end_; ++cur_, ++charsRead_) {
+      const char c = *cur_;
+
+      if (ExpressionParser::isDecimalPoint(c)) {
+	if (hasDecPoint) {
+	  ++charsRead_;
+	  throw Exceptions::UnexpectedSymbol(c);
+	}
+
+	hasDecPoint = true;
+      }
+      else if (!isDigit(c))
+	break;
+    }
+
+    // Forbid . (a lone comma is reported as a point too)
+    if (hasDecPoint && cur_ - begin == 1)
+      throw Exceptions::UnexpectedSymbol('.');
+
+    return decimalToDouble(begin, cur_);
+  }
+
+  void readIdentifier() {
+    const char* begin = cur_;
+
+    while (cur_ != end_ && (isIdentifierStart(*cur_) || isDigit(*cur_)))
+      ++cur_;
+
+    charsRead_+= cur_ - begin;
+    identifiers_.insert(builder_, begin, cur_);
+  }
+
+  std::string readBadSymbols() {
+    /* For some reason according to the ToR we're supposed to return the
+       whole line of bad symbols in the exception, not just the first
+       one. Well, whatever. */
+    static const char goodSymbols[] = " +-*/().,0123456789";
+    const char* begin = cur_;
+
+    while (!terminalReached() && (*cur_ == '\0' || !std::strchr(goodSymbols, *cur_)))
+      ++cur_; // Do not increase counter
+
+    return std::string(begin, cur_);
+  }
+
+  bool terminalReached() const {
+    return cur_ == end_ || *cur_ == '\n';
+  }
+
+  char readNextChar() {
+    ++charsRead_;
+    return *cur_++;
+  }
+
+  const char* cur_;
+  const char* end_;
+  Builder& builder_;
+  Identifiers identifiers_;
+
+  std::size_t charsRead_ = 0;
+  bool exprEndReached_ = false;
+  TokenType lastRead_ = TokenType::Empty;
+};
+
+/* The insertions of EvaluationTree without the tree. An operator waits
+   on a stack until its right operand is complete, and is applied as
+   soon as an operator of no higher priority follows, which is where
+   insertOperator() would have placed it. Open groups wait on the same
+   stack with the lowest priority. The stack only grows with the
+   nesting of parentheses and unary operators, not with the length of
+   the expression.
+
+   Applying an operator is up to the target: it gets operand(value)
+   for every operand and apply(operator, unary) for every operator,
+   in the order in which the tree would evaluate them. */
+template <typename Target>
+class PrecedenceStack {
+public:
+  explicit PrecedenceStack(Target& target): target_(target) { }
+
+  void insertOperand(const double value) {
+    if (filled_)
+      throw Exceptions::UnexpectedOperand();
+
+    target_.operand(value);
+    filled_ = true;
+    started_ = true;
+  }
+
+  void insertOperator(const char symbol) {
+    const Operator op(symbol);
+
+    if (!filled_) {
+      if (!op.canBeUnary())
+	throw Exceptions::UnexpectedOperator();
+
+      push({ op, op.unaryPriority(), true });
+    }
+    else {
+      // The tree would climb over these, so their operands are complete
+      const short priority = op.binaryPriority();
+      while (!pending_.empty() && pending_.back().priority >= priority)
+	reduce();
+
+      push({ op, priority, false });
+      filled_ = false;
+    }
+
+    started_ = true;
+  }
+
+  void openGroup() {
+    if (filled_)
+      throw Exceptions::UnexpectedOperand();
+
+    push({ Operator('('), 0, false });
+    ++groups_;
+    started_ = true;
+  }
+
+  void closeGroup() {
+    if (!groups_ || !isReady())
+      throw Exceptions::UnexpectedExpressionEnd();
+
+    while (pending_.back().priority)
+      reduce();
+
+    pending_.pop_back();
+    --groups_;
+  }
+
+  // Applies the operators still waiting, once the input is over
+  void finish() {
+    if (groups_ || !isReady())
+      throw Exceptions::UnexpectedExpressionEnd();
+
+    while (!pending_.empty())
+      reduce();
+  }
+
+  bool isReady() const {
+    return filled_ || !started_;
+  }
+
+  bool groupOpen() const {
+    return groups_;
+  }
+
+  // The most operators and groups that were waiting at once
+  std::size_t getMaxDepth() const {
+    return maxDepth_;
+  }
+
+private:
+  struct Pending {
+    Operator op;
+    short priority;
+    bool unary;
+  };
+
+  void push(const Pending& pending) {
+    pending_.push_back(pending);
+    if (pending_.size() > maxDepth_)
+      maxDepth_ = pending_.size();
+  }
+
+  void reduce() {
+    const Pending top = pending_.back();
+    pending_.pop_back();
+    target_.apply(top.op, top.unary);
+  }
+
+  Target& target_;
+
+  std::vector<Pending> pending_;
+  std::size_t groups_ = 0;
+  std::size_t maxDepth_ = 0;
+
+  // Whether the last operator (or group) has got its operand
+  bool filled_ = false;
+  bool started_ = false;
+};
+
+#endif
@@ -0,0 +1,308 @@
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <system_error>
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/timerfd.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "server.h"
+
+static void check(const int result, const char* what) {
+  if (result < 0)
+    throw std::system_error(errno, std::generic_category(), what);
+}
+
+static void control(const int epollFd, const int op, const int fd, const std::uint32_t events) {
+  epoll_event event;
+  event.events = events;
+  event.data.fd = fd;
+
+  check(epoll_ctl(epollFd, op, fd, &event), "epoll_ctl");
+}
+
+CalcServer::CalcServer(const std::string& path, const Limits& limits,
+		       const std::size_t cacheCapacity, const std::size_t cacheBytes):
+  path_(path), limits_(limits), evaluator_(cacheCapacity, cacheBytes) {
+  sockaddr_un address;
+  std::memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+
+  if (path.size() >= sizeof(address.sun_path))
+    throw std::system_error(ENAMETOOLONG, std::generic_category(), path);
+  std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+
+  try {
+    // A socket left over by a server that is gone, nobody answers on it
+    struct stat status;
+    if (!stat(path.c_str(), &status) && S_ISSOCK(status.st_mode)) {
+      check(listenFd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0), "socket");
+      const bool answered = !connect(listenFd_, reinterpret_cast<sockaddr*>(&address), sizeof(address));
+      const bool stale = !answered && errno == ECONNREFUSED;
+      ::close(listenFd_);
+      listenFd_ = -1;
+
+      if (answered)
+	throw std::system_error(EADDRINUSE, std::generic_category(), path);
+      if (stale)
+	unlink(path.c_str());
+    }
+
+    check(listenFd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0), "socket");
+    check(bind(listenFd_, reinterpret_cast<sockaddr*>(&address), sizeof(address)), "bind");
+    check(listen(listenFd_, SOMAXCONN), "listen");
+
+    check(epollFd_ = epoll_create1(EPOLL_CLOEXEC), "epoll_create1");
+    check(stopFd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC), "eventfd");
+    check(retryFd_ = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC), "timerfd_create");
+
+    control(epollFd_, EPOLL_CTL_ADD, stopFd_, EPOLLIN);
+    control(epollFd_, EPOLL_CTL_ADD, retryFd_, EPOLLIN);
+    control(epollFd_, EPOLL_CTL_ADD, listenFd_, EPOLLIN);
+    listening_ = true;
+  }
+  catch (...) {
+    for (const int fd : { listenFd_, epollFd_, stopFd_, retryFd_ })
+      if (fd >= 0)
+	::close(fd);
+    throw;
+  }
+}
+
+CalcServer::~CalcServer() {
+  for (auto& connection : connections_)
+    ::close(connection.first);
+
+  ::close(listenFd_);
+  ::close(epollFd_);
+  ::close(stopFd_);
+  ::close(retryFd_);
+  unlink(path_.c_str());
+}
+
+void CalcServer::stop() {
+  // The interrupted code may be about to look at errno
+  const int error = errno;
+  const std::uint64_t one = 1;
+
+  // A full counter already has the loop woken up
+  const ssize_t written = write(stopFd_, &one, sizeof(one));
+  (void) written;
+
+  errno = error;
+}
+
+void CalcServer::run() {
+  static const int maxEvents = 256;
+  epoll_event events[maxEvents];
+
+  for (;;) {
+    const int count = epoll_wait(epollFd_, events, maxEvents, -1);
+    if (count < 0) {
+      if (errno == EINTR)
+	continue;
+      check(count, "epoll_wait");
+    }
+
+    for (int i = 0; i < count; ++i) {
+      const int fd = events[i].data.fd;
+
+      if (fd == stopFd_) {
+	std::uint64_t value;
+	if (read(stopFd_, &value, sizeof(value)) < 0 && errno != EAGAIN)
+	  throw std::system_error(errno, std::generic_category(), "read");
+	return;
+      }
+
+      if (fd == listenFd_) {
+	acceptClients();
+	continue;
+      }
+
+      if (fd == retryFd_) {
+	std::uint64_t expirations;
+	if (read(retryFd_, &expirations, sizeof(expirations)) < 0 && errno != EAGAIN)
+	  throw std::system_error(errno, std::generic_category(), "read");
+	setListening(connections_.size() < limits_.maxConnections);
+	continue;
+      }
+
+      // Closed while handling the previous events
+      auto it = connections_.find(fd);
+      if (it == connections_.end())
+	continue;
+
+      Connection& connection = *it->second;
+      bool alive = true;
+
+      if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+	alive = readInput(connection);
+      if (alive && connection.sent != connection.output.size())
+	alive = writeOutput(connection);
+      if (alive && connection.inputClosed && connection.sent == connection.output.size())
+	alive = false;
+
+      if (alive)
+	updateEvents(connection);
+      else
+	disconnect(connection);
+    }
+  }
+}
+
+void CalcServer::acceptClients() {
+  while (connections_.size() < limits_.maxConnections) {
+    const int fd = accept4(listenFd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+
+    if (fd < 0) {
+      if (errno == EINTR || errno == ECONNABORTED)
+	continue;
+
+      // Out of descriptors: wait for a client to leave, or for a while
+      if (errno == EMFILE || errno == ENFILE) {
+	setListening(false);
+	retryLater();
+      }
+      else if (errno != EAGAIN && errno != EWOULDBLOCK)
+	check(fd, "accept4");
+      return;
+    }
+
+    std::unique_ptr<Connection> connection(new Connection());
+    connection->fd = fd;
+    connection->events = EPOLLIN;
+
+    connections_.emplace(fd, std::move(connection));
+    control(epollFd_, EPOLL_CTL_ADD, fd, EPOLLIN);
+  }
+
+  // The rest wait in the backlog until there is room
+  setListening(false);
+}
+
+void CalcServer::setListening(const bool listening) {
+  if (listening_ != listening) {
+    control(epollFd_, EPOLL_CTL_MOD, listenFd_, listening ? static_cast<std::uint32_t>(EPOLLIN) : 0);
+    listening_ = listening;
+  }
+}
+
+void CalcServer::retryLater() {
+  itimerspec timer;
+  std::memset(&timer, 0, sizeof(timer));
+  timer.it_value.tv_nsec = 100 * 1000 * 1000;
+
+  check(timerfd_settime(retryFd_, 0, &timer, nullptr), "timerfd_settime");
+}
+
+void CalcServer::updateEvents(Connection& connection) {
+  const std::size_t pending = connection.output.size() - connection.sent;
+  std::uint32_t events = 0;
+
+  if (!connection.inputClosed && pending < limits_.maxPendingOutput)
+    events|= EPOLLIN;
+  if (pending)
+    events|= EPOLLOUT;
+
+  if (events != connection.events) {
+    control(epollFd_, EPOLL_CTL_MOD, connection.fd, events);
+    connection.events = events;
+  }
+}
+
+bool CalcServer::readInput(Connection& connection) {
+  // A few reads at a time, so that one busy client cannot hog the loop
+  static const int maxReads = 16;
+  char buffer[64 * 1024];
+
+  for (int reads = 0; reads < maxReads && !connection.inputClosed
+	 && connection.output.size() - connection.sent < limits_.maxPendingOutput; ++reads) {
+    const ssize_t length = read(connection.fd, buffer, sizeof(buffer));
+
+    if (length < 0) {
+      if (errno == EINTR)
+	continue;
+      return errno == EAGAIN || errno == EWOULDBLOCK;
+    }
+
+    if (!length)
+      connection.inputClosed = true;
+    else if (stats_)
+      stats_->add(Statistics::BytesRead, length);
+
+    connection.input.append(buffer, length);
+    evaluateLines(connection, connection.inputClosed);
+
+    if (connection.input.size() > limits_.maxLineLength)
+      return false;
+  }
+
+  return true;
+}
+
+bool CalcServer::writeOutput(Connection& connection) {
+  while (connection.sent != connection.output.size()) {
+    const ssize_t length = send(connection.fd, connection.output.data() + connection.sent,
+				connection.output.size() - connection.sent, MSG_NOSIGNAL);
+
+    if (length < 0) {
+      if (errno == EINTR)
+	continue;
+      if (errno != EAGAIN && errno != EWOULDBLOCK)
+	return false;
+      break;
+    }
+
+    connection.sent+= length;
+  }
+
+  // What was sent goes away once there is enough of it
+  if (connection.sent == connection.output.size()) {
+    connection.output.clear();
+    connection.sent = 0;
+  }
+  else if (connection.sent > 64 * 1024) {
+    connection.output.erase(0, connection.sent);
+    connection.sent = 0;
+  }
+
+  return true;
+}
+
+void CalcServer::evaluateLines(Connection& connection, const bool all) {
+  const char* begin = connection.input.data();
+  const char* end = begin + connection.input.size();
+
+  // A partial line waits for the rest of it, unless the input is over
+  if (!all) {
+    const void* eol = memrchr(begin, '\n', end - begin);
+    if (!eol)
+      return;
+
+    end = static_cast<const char*>(eol) + 1;
+  }
+
+  for (const char* pos = begin; pos != end; ) {
+    if (evaluator_.evaluateLine(pos, end, text_) != LineEvaluator::Outcome::Nothing) {
+      connection.output+= text_;
+      connection.output.push_back('\n');
+    }
+  }
+
+  connection.input.erase(0, end - begin);
+}
+
+void CalcServer::disconnect(Connection& connection) {
+  const int fd = connection.fd;
+
+  control(epollFd_, EPOLL_CTL_DEL, fd, 0);
+  ::close(fd);
+  connections_.erase(fd);
+
+  setListening(true);
+}
@@ -0,0 +1,88 @@
+#ifndef __SERVER_H__
+#define __SERVER_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+#include "evaluator.h"
+#include "stats.h"
+
+/* Serves calc over a Unix domain socket. Clients send expressions a
+   line at a time and may pipeline as many as they like; every line
+   but the blank ones gets a line back with the result or the error
+   message, in order. A single thread runs a non-blocking epoll loop
+   and evaluates the lines with one LineEvaluator. */
+class CalcServer {
+public:
+  struct Limits {
+    std::size_t maxConnections = 1024;
+    // A longer line without a break closes the connection
+    std::size_t maxLineLength = 1 << 20;
+    // Reading from a client stops while this much is left to send
+    std::size_t maxPendingOutput = 1 << 20;
+  };
+
+  /* Binds the socket, replacing a stale one that nobody listens on;
+     throws std::system_error, with EADDRINUSE if a server answers */
+  CalcServer(const std::string& path, const Limits&,
+	     const std::size_t cacheCapacity = 0, const std::size_t cacheBytes = 0);
+  ~CalcServer();
+  CalcServer(const CalcServer&) = delete;
+  CalcServer& operator=(const CalcServer&) = delete;
+
+  // Serves until stopped
+  void run();
+  // May be called from any thread, or from a signal handler
+  void stop();
+
+  void setStatistics(Statistics* stats) {
+    stats_ = stats;
+    evaluator_.setStatistics(stats);
+  }
+
+  std::size_t getConnectionCount() const {
+    return connections_.size();
+  }
+
+private:
+  struct Connection {
+    int fd;
+    std::string input;
+    std::string output;
+    std::size_t sent = 0;
+    bool inputClosed = false;
+    std::uint32_t events = 0;
+  };
+
+  void acceptClients();
+  void updateEvents(Connection&);
+  void setListening(const bool);
+  // Listens again after a while, when descriptors ran out
+  void retryLater();
+
+  // False once the connection is done with and has to be closed
+  bool readInput(Connection&);
+  bool writeOutput(Connection&);
+  void evaluateLines(Connection&, const bool all);
+  void disconnect(Connection&);
+
+  std::string path_;
+  Limits limits_;
+
+  int listenFd_ = -1;
+  int epollFd_ = -1;
+  int stopFd_ = -1;
+  int retryFd_ = -1;
+  bool listening_ = false;
+
+  LineEvaluator evaluator_;
+  std::string text_;
+  Statistics* stats_ = nullptr;
+
+  std::unordered_map<int, std::unique_ptr<Connection>> connections_;
+};
+
+#endif
@@ -0,0 +1,113 @@
+#include "simd.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SIMD_X86
+#include <immintrin.h>
+#endif
+
+#define SCALAR_BINARY_KERNEL(name, op)					\
+  static void name(const double* lhs, const double* rhs, double* out, std::size_t n) { \
+    for (std::size_t i = 0; i < n; ++i)					\
+      out[i] = lhs[i] op rhs[i];					\
+  }
+
+SCALAR_BINARY_KERNEL(scalarAdd, +)
+SCALAR_BINARY_KERNEL(scalarSubtract, -)
+SCALAR_BINARY_KERNEL(scalarMultiply, *)
+SCALAR_BINARY_KERNEL(scalarDivide, /)
+
+static void scalarNegate(const double* arg, double* out, std::size_t n) {
+  for (std::size_t i = 0; i < n; ++i)
+    out[i] = -arg[i];
+}
+
+static const ColumnKernels scalarKernels = {
+  "scalar", scalarAdd, scalarSubtract, scalarMultiply, scalarDivide, scalarNegate
+};
+
+#ifdef SIMD_X86
+
+/* The vector loops leave the tail to the scalar ones. Negation flips
+   the sign bit just like the scalar code does, so that zeros and NaNs
+   keep matching. */
+#define SSE2_BINARY_KERNEL(name, intrinsic, op)				\
+  __attribute__((target("sse2")))					\
+  static void name(const double* lhs, const double* rhs, double* out, std::size_t n) { \
+    std::size_t i = 0;							\
+    for (; i + 2 <= n; i+= 2)						\
+      _mm_storeu_pd(out + i, intrinsic(_mm_loadu_pd(lhs + i), _mm_loadu_pd(rhs + i))); \
+    for (; i < n; ++i)							\
+      out[i] = lhs[i] op rhs[i];					\
+  }
+
+SSE2_BINARY_KERNEL(sse2Add, _mm_add_pd, +)
+SSE2_BINARY_KERNEL(sse2Subtract, _mm_sub_pd, -)
+SSE2_BINARY_KERNEL(sse2Multiply, _mm_mul_pd, *)
+SSE2_BINARY_KERNEL(sse2Divide, _mm_div_pd, /)
+
+__attribute__((target("sse2")))
+static void sse2Negate(const double* arg, double* out, std::size_t n) {
+  const __m128d sign = _mm_set1_pd(-0.0);
+  std::size_t i = 0;
+
+  for (; i + 2 <= n; i+= 2)
+    _mm_storeu_pd(out + i, _mm_xor_pd(_mm_loadu_pd(arg + i), sign));
+  for (; i < n; ++i)
+    out[i] = -arg[i];
+}
+
+#define AVX2_BINARY_KERNEL(name, intrinsic, op)				\
+  __attribute__((target("avx2")))					\
+  static void name(const double* lhs, const double* rhs, double* out, std::size_t n) { \
+    std::size_t i = 0;							\
+    for (; i + 4 <= n; i+= 4)						\
+      _mm256_storeu_pd(out + i, intrinsic(_mm256_loadu_pd(lhs + i), _mm256_loadu_pd(rhs + i))); \
+    for (; i < n; ++i)							\
+      out[i] = lhs[i] op rhs[i];					\
+  }
+
+AVX2_BINARY_KERNEL(avx2Add, _mm256_add_pd, +)
+AVX2_BINARY_KERNEL(avx2Subtract, _mm256_sub_pd, -)
+AVX2_BINARY_KERNEL(avx2Multiply, _mm256_mul_pd, *)
+AVX2_BINARY_KERNEL(avx2Divide, _mm256_div_pd, /)
+
+__attribute__((target("avx2")))
+static void avx2Negate(const double* arg, double* out, std::size_t n) {
+  const __m256d sign = _mm256_set1_pd(-0.0);
+  std::size_t i = 0;
+
+  for (; i + 4 <= n; i+= 4)
+    _mm256_storeu_pd(out + i, _mm256_xor_pd(_mm256_loadu_pd(arg + i), sign));
+  for (; i < n; ++i)
+    out[i] = -arg[i];
+}
+
+static const ColumnKernels sse2Kernels = {
+  "sse2", sse2Add, sse2Subtract, sse2Multiply, sse2Divide, sse2Negate
+};
+
+static const ColumnKernels avx2Kernels = {
+  "avx2", avx2Add, avx2Subtract, avx2Multiply, avx2Divide, avx2Negate
+};
+
+#endif
+
+std::vector<const ColumnKernels*> supportedColumnKernels() {
+  std::vector<const ColumnKernels*> result = { &scalarKernels };
+
+#ifdef SIMD_X86
+  __builtin_cpu_init();
+
+  if (__builtin_cpu_supports("sse2"))
+    result.push_back(&sse2Kernels);
+  if (__builtin_cpu_supports("avx2"))
+    result.push_back(&avx2Kernels);
+#endif
+
+  return result;
+}
+
+const ColumnKernels& bestColumnKernels() {
+  static const ColumnKernels& best = *supportedColumnKernels().back();
+  return best;
+}
@@ -0,0 +1,26 @@
+#ifndef __SIMD_H__
+#define __SIMD_H__
+
+#include <cstddef>
+#include <vector>
+
+/* Element-wise operators over whole columns. Every implementation
+   gives the same bits as the scalar operators; the output may alias
+   the first argument but not the second. */
+struct ColumnKernels {
+  const char* name;
+
+  void (*add)(const double* lhs, const double* rhs, double* out, std::size_t n);
+  void (*subtract)(const double* lhs, const double* rhs, double* out, std::size_t n);
+  void (*multiply)(const double* lhs, const double* rhs, double* out, std::size_t n);
+  void (*divide)(const double* lhs, const double* rhs, double* out, std::size_t n);
+  void (*negate)(const double* arg, double* out, std::size_t n);
+};
+
+// The widest kernels the CPU supports, detected once through CPUID
+const ColumnKernels& bestColumnKernels();
+
+// Every set of kernels the CPU supports, the scalar fallback first
+std::vector<const ColumnKernels*> supportedColumnKernels();
+
+#endif
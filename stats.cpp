@@ -0,0 +1,46 @@
+#include <iomanip>
+#include <sstream>
+
+#include "stats.h"
+
+Statistics::Statistics() {
+  for (auto& counter : counters_)
+    counter.store(0, std::memory_order_relaxed);
+}
+
+void Statistics::countError(const Exceptions::ParsingException& e) {
+  if (dynamic_cast<const Exceptions::UnexpectedOperator*>(&e))
+    add(UnexpectedOperators, 1);
+  else if (dynamic_cast<const Exceptions::UnexpectedOperand*>(&e))
+    add(UnexpectedOperands, 1);
+  else if (dynamic_cast<const Exceptions::UnexpectedExpressionEnd*>(&e))
+    add(UnexpectedEnds, 1);
+  else if (dynamic_cast<const Exceptions::BadSymbols*>(&e))
+    add(BadSymbols, 1);
+  else
+    add(UnexpectedSymbols, 1);
+}
+
+void Statistics::merge(const Statistics& rhs) {
+  for (int i = 0; i < CounterCount; ++i)
+    if (const std::uint64_t value = rhs.get(static_cast<Counter>(i)))
+      add(static_cast<Counter>(i), value);
+}
+
+std::string Statistics::summary() const {
+  const std::uint64_t errors = get(UnexpectedOperators) + get(UnexpectedOperands) + get(UnexpectedEnds)
+    + get(BadSymbols) + get(UnexpectedSymbols);
+
+  std::ostringstream out;
+  out << std::fixed << std::setprecision(3)
+      << "статистика: строк " << get(Lines) << ", выражений " << get(Expressions)
+      << " (из кэша " << get(CacheHits) << "), ошибок " << errors
+      << ", узлов " << get(NodesBuilt) << ", байт прочитано " << get(BytesRead) << "\n"
+      << "  ошибки: оператор " << get(UnexpectedOperators) << ", число " << get(UnexpectedOperands)
+      << ", обрыв " << get(UnexpectedEnds) << ", недопустимые символы " << get(BadSymbols)
+      << ", неожиданный символ " << get(UnexpectedSymbols) << "\n"
+      << "  время, мс: чтение " << get(ReadTime) / 1e6 << ", разбор " << get(ParseTime) / 1e6
+      << ", вычисление " << get(EvaluateTime) / 1e6 << ", форматирование " << get(FormatTime) / 1e6 << "\n";
+
+  return out.str();
+}
@@ -0,0 +1,81 @@
+#ifndef __STATS_H__
+#define __STATS_H__
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+#include "exceptions.h"
+
+/* Counters and phase timers of calc's --stats mode. They are relaxed
+   atomics, so a summary may be taken while evaluation goes on. */
+class Statistics {
+public:
+  enum Counter {
+    Lines,
+    Expressions,
+    CacheHits,
+    BytesRead,
+    NodesBuilt,
+    // Errors by the type of the exception
+    UnexpectedOperators,
+    UnexpectedOperands,
+    UnexpectedEnds,
+    BadSymbols,
+    UnexpectedSymbols,
+    // Time spent, in nanoseconds
+    ReadTime,
+    ParseTime,
+    EvaluateTime,
+    FormatTime,
+    CounterCount
+  };
+
+  Statistics();
+  Statistics(const Statistics&) = delete;
+  Statistics& operator=(const Statistics&) = delete;
+
+  void add(const Counter counter, const std::uint64_t value) {
+    counters_[counter].fetch_add(value, std::memory_order_relaxed);
+  }
+
+  std::uint64_t get(const Counter counter) const {
+    return counters_[counter].load(std::memory_order_relaxed);
+  }
+
+  void countError(const Exceptions::ParsingException&);
+  void merge(const Statistics&);
+
+  std::string summary() const;
+
+private:
+  std::atomic<std::uint64_t> counters_[CounterCount];
+};
+
+/* Adds the time of its scope to a timer of the statistics, if there
+   are any: without them it costs a single check. */
+class PhaseTimer {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  PhaseTimer(Statistics* stats, const Statistics::Counter timer): stats_(stats), timer_(timer) {
+    if (stats_)
+      start_ = Clock::now();
+  }
+
+  ~PhaseTimer() {
+    if (stats_)
+      stats_->add(timer_, std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start_).count());
+  }
+
+  PhaseTimer(const PhaseTimer&) = delete;
+  PhaseTimer& operator=(const PhaseTimer&) = delete;
+
+private:
+  Statistics* stats_;
+  Statistics::Counter timer_;
+  Clock::time_point start_;
+};
+
+#endif
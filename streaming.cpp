@@ -0,0 +1,142 @@
+#include <cerrno>
+#include <cstring>
+#include <system_error>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "exceptions.h"
+#include "format.h"
+#include "output.h"
+#include "reader.h"
+#include "streaming.h"
+
+namespace {
+
+// The values of the subexpressions still waiting for their operators
+class ValueStack {
+public:
+  void operand(const double value) {
+    values_.push_back(value);
+  }
+
+  void apply(const Operator& op, const bool unary) {
+    if (unary) {
+      values_.back() = op(values_.back());
+      return;
+    }
+
+    const double right = values_.back();
+    values_.pop_back();
+    values_.back() = op(values_.back(), right);
+  }
+
+  double result() const {
+    return values_.empty() ? 0 : values_.back();
+  }
+
+private:
+  std::vector<double> values_;
+};
+
+}
+
+StreamingEvaluator StreamingEvaluator::evaluateBuffer(const char* begin, const char* end) {
+  ValueStack values;
+  PrecedenceStack<ValueStack> operators(values);
+  ExpressionReader<PrecedenceStack<ValueStack>> reader(begin, end, operators);
+
+  reader.read();
+  operators.finish();
+
+  StreamingEvaluator evaluator;
+  evaluator.result_ = values.result();
+  evaluator.nothingRead_ = reader.nothingRead();
+  evaluator.charsRead_ = reader.getCharsRead();
+  evaluator.position_ = reader.getPosition();
+  evaluator.maxDepth_ = operators.getMaxDepth();
+
+  return evaluator;
+}
+
+MappedFile::MappedFile(const std::string& path) {
+  const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    throw std::system_error(errno, std::generic_category(), path);
+
+  struct stat status;
+  if (fstat(fd, &status)) {
+    const int error = errno;
+    close(fd);
+    throw std::system_error(error, std::generic_category(), path);
+  }
+
+  size_ = status.st_size;
+
+  if (size_) {
+    void* memory = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (memory == MAP_FAILED) {
+      const int error = errno;
+      close(fd);
+      throw std::system_error(error, std::generic_category(), "mmap");
+    }
+
+    // Read-ahead is doubled and the pages behind go first
+    madvise(memory, size_, MADV_SEQUENTIAL);
+    data_ = static_cast<const char*>(memory);
+  }
+
+  close(fd);
+}
+
+MappedFile::~MappedFile() {
+  if (data_)
+    munmap(const_cast<char*>(data_), size_);
+}
+
+void evaluateStreaming(const char* begin, const char* end, std::ostream& out, std::ostream& err,
+		       Statistics* stats) {
+  OutputBuffer output(out);
+  char buffer[formatBufferSize];
+  const char* pos = begin;
+
+  while (pos != end) {
+    double value;
+
+    if (stats)
+      stats->add(Statistics::Lines, 1);
+
+    try {
+      PhaseTimer timer(stats, Statistics::EvaluateTime);
+      const StreamingEvaluator evaluator = StreamingEvaluator::evaluateBuffer(pos, end);
+      pos = evaluator.getPosition();
+
+      if (evaluator.nothingRead())
+	continue;
+
+      value = evaluator.getResult();
+    }
+    catch (Exceptions::ParsingException& e) {
+      if (stats)
+	stats->countError(e);
+
+      output.flush();
+      err << e.what() << std::endl;
+
+      const void* eol = std::memchr(pos, '\n', end - pos);
+      pos = eol ? static_cast<const char*>(eol) + 1 : end;
+      continue;
+    }
+
+    if (stats)
+      stats->add(Statistics::Expressions, 1);
+
+    PhaseTimer timer(stats, Statistics::FormatTime);
+    output.writeLine(buffer, formatDouble(value, buffer));
+  }
+
+  if (stats)
+    stats->add(Statistics::BytesRead, end - begin);
+}
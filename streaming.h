@@ -0,0 +1,86 @@
+#ifndef __STREAMING_H__
+#define __STREAMING_H__
+
+#include <cstddef>
+#include <iostream>
+#include <string>
+
+#include "stats.h"
+
+/* Evaluates an expression in a single pass over its text without
+   building a tree: the operators are applied as a PrecedenceStack
+   (reader.h) lets them go, so memory grows with the nesting of the
+   expression and not with its length. The result matches the tree's
+   bit for bit, and errors are the same exceptions with the same
+   positions as ExpressionParser's. */
+class StreamingEvaluator {
+public:
+  // Evaluates the expression up to and including the terminating '\n'
+  static StreamingEvaluator evaluateBuffer(const char* begin, const char* end);
+
+  double getResult() const {
+    return result_;
+  }
+
+  bool nothingRead() const {
+    return nothingRead_;
+  }
+
+  std::size_t getCharsRead() const {
+    return charsRead_;
+  }
+
+  // Past the expression and its terminator
+  const char* getPosition() const {
+    return position_;
+  }
+
+  // The most operators and groups that were waiting at once
+  std::size_t getMaxDepth() const {
+    return maxDepth_;
+  }
+
+private:
+  StreamingEvaluator() = default;
+
+  double result_ = 0;
+  bool nothingRead_ = true;
+  std::size_t charsRead_ = 0;
+  const char* position_ = nullptr;
+  std::size_t maxDepth_ = 0;
+};
+
+/* A whole file mapped for reading, to be read through once from start
+   to end. The pages behind are dropped by the kernel as it sees fit,
+   so a file of any size takes little memory. Empty files map to an
+   empty range. Throws std::system_error. */
+class MappedFile {
+public:
+  explicit MappedFile(const std::string& path);
+  ~MappedFile();
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  const char* begin() const {
+    return data_;
+  }
+
+  const char* end() const {
+    return data_ + size_;
+  }
+
+  std::size_t size() const {
+    return size_;
+  }
+
+private:
+  const char* data_ = nullptr;
+  std::size_t size_ = 0;
+};
+
+/* Evaluates every line of the range the way calc does, with results
+   and error messages in input order. A line may be of any length. */
+void evaluateStreaming(const char* begin, const char* end, std::ostream& out, std::ostream& err,
+		       Statistics* stats = nullptr);
+
+#endif
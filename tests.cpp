@@ -1,15 +1,49 @@
+#include <chrono>
 #include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
 #include <exception>
+#include <fstream>
 #include <functional>
 #include <iomanip>
 #include <iostream>
 #include <memory>
+#include <random>
 #include <sstream>
+#include <system_error>
+#include <thread>
 #include <utility>
 #include <vector>
 
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "batch.h"
+#include "bytecode.h"
+#include "cache.h"
+#include "compact.h"
+#include "dag.h"
+#include "decimal.h"
+#include "evaluator.h"
 #include "exceptions.h"
+#include "format.h"
+#include "generator.h"
+#include "jit.h"
+#include "library.h"
+#include "literal.h"
+#include "optimizer.h"
+#include "parallel.h"
 #include "parser.h"
+#include "pipeline.h"
+#include "pool.h"
+#include "prepared.h"
+#include "queue.h"
+#include "server.h"
+#include "stats.h"
+#include "streaming.h"
 
 #define TEST(name) void name()
 #define RUNTEST(name) Tester::instance().runTest(#name, &name);
@@ -84,6 +118,10 @@ private:
   unsigned passed_ = 0;
 };
 
+bool bitwiseEqual(const double lhs, const double rhs) {
+  return std::memcmp(&lhs, &rhs, sizeof(double)) == 0;
+}
+
 const double eps = 0.01;
 void assumeResult(const std::string& inp, const double assumption) {
   Tester::instance().setLastQuery(inp);
@@ -92,6 +130,18 @@ void assumeResult(const std::string& inp, const double assumption) {
   auto parser = ExpressionParser::parseStream(stream);
   double result = parser.getTree().evaluate();
 
+  // Both engines must agree down to the last bit
+  const double compiled = CompiledExpression::compile(parser.getTree()).evaluate();
+  if (!bitwiseEqual(result, compiled)) {
+    std::ostringstream resStr;
+    std::ostringstream compStr;
+
+    resStr << std::setprecision(17) << result;
+    compStr << std::setprecision(17) << compiled;
+
+    throw TestFailed(std::string("bytecode result ") + resStr.str(), compStr.str());
+  }
+
   if (std::abs(result - assumption) > eps) {
     std::ostringstream assStr;
     std::ostringstream resStr;
@@ -129,100 +179,6 @@ void assumeException(const std::string& inp, const size_t pos, Args... exArgs) {
   throw TestFailed(std::string("exception '") + ass.what() + "'", resStr.str());
 }
 
-struct Expr {
-  virtual ~Expr() = default;
-  virtual std::string serialize() const = 0;
-  virtual double evaluate() const = 0;
-};
-
-struct OperationsChain: Expr {
-  std::string serialize() const override { 
-    static std::string vals = "+-*/";
-    std::ostringstream ser;
-    
-    ser << "(" << operChain.front()->serialize();
-    for (size_t i = 1; i < operChain.size(); ++i) {
-      ser << vals[signChain[i-1]] << operChain[i]->serialize();
-    }
-    ser << ")";
-
-    return ser.str();
-  }
-
-  double evaluate() const override {
-    double result = operChain.front()->evaluate();
-
-    for (size_t i = 1; i < operChain.size(); ++i) {
-      switch(signChain[i-1]) {
-      case 0: result+= operChain[i]->evaluate(); break;
-      case 1: result-= operChain[i]->evaluate(); break;
-      case 2: result*= operChain[i]->evaluate(); break;
-      default: result/= operChain[i]->evaluate(); break;
-      }
-    }
-
-    return result;
-  }
-
-  std::vector<std::shared_ptr<Expr>> operChain;
-  std::vector<short> signChain;
-};
-
-struct Block: Expr {
-  std::string serialize() const override { return std::string("(") + content->serialize() + ")"; }
-  double evaluate() const override { return content->evaluate(); }
-
-  std::shared_ptr<Expr> content;
-};
-
-struct Number: Expr {
-  std::string serialize() const override { 
-    std::ostringstream str;
-    str << std::setprecision(2) << std::fixed << num;
-    return str.str();
-  }
-  double evaluate() const override { return num; }
-
-  double num;
-};
-
-int randInt(const int from, const int to) {
-  return (rand() % (to - from + 1)) + from;
-}
-
-std::shared_ptr<Expr> generateRandomExpression(unsigned depth = 0) {
-  /* My random is so big you can't handle it */
-  const int choice = depth < 8 ? randInt(0, 2) : 0;
-  switch(choice) {
-  case 0: {
-    auto numExpr = std::make_shared<Number>();
-    numExpr->num = static_cast<double>(randInt(-10000, 10000)) / 100.0;
-    return numExpr;
-  }
-  case 1: {
-    auto operExpr = std::make_shared<OperationsChain>();
-    const int chainSize = randInt(2, 4);
-    const int chainPriority = randInt(0, 1);
-
-    operExpr->operChain.reserve(chainSize);
-    operExpr->signChain.reserve(chainSize - 1);
-
-    for (int i = 0; i < chainSize; ++i) {
-      if (i > 0)
-	operExpr->signChain.push_back(static_cast<short>(chainPriority * 2 + randInt(0, 1)));
-      operExpr->operChain.push_back(generateRandomExpression(depth+1));
-    }
-
-    return operExpr;
-  }
-  default: {
-    auto blExpr = std::make_shared<Block>();
-    blExpr->content = generateRandomExpression(depth+1);
-    return blExpr;
-  }
-  }
-}
-
 TEST(fundamental_equality) {
   assumeResult("2 * 2", 4);
 }
@@ -299,6 +255,531 @@ TEST(bad_cases) {
   assumeException<UnexpectedSymbol>("(2+3)2)+1", 7, ')');
 
   assumeException<UnexpectedSymbol>(".", 1, '.');
+  assumeException<UnexpectedSymbol>("2 + ,", 5, '.');
+}
+
+TEST(compiled_expressions) {
+  // Sign of zero and IEEE specials have to survive compilation
+  assumeResult("-0", 0);
+  assumeResult("-(0*-1)", 0);
+  assumeResult("+-+-+3", 3);
+
+  std::istringstream stream("1/0 - 2/0");
+  auto parser = ExpressionParser::parseStream(stream);
+  auto compiled = CompiledExpression::compile(parser.getTree());
+
+  if (!std::isnan(compiled.evaluate()))
+    throw TestFailed("nan", std::to_string(compiled.evaluate()));
+
+  // Deep right-leaning input needs more than the on-stack buffer
+  std::string deep;
+  for (int i = 0; i < 100; ++i)
+    deep+= "1-(";
+  deep+= "1";
+  deep+= std::string(100, ')');
+
+  assumeResult(deep, 1);
+}
+
+void assumeNative(const EvaluationTree& tree, const OperandType* variables = nullptr) {
+  const double expected = tree.evaluate();
+  const JitFunction function = JitFunction::compile(tree);
+  const double result = function.getFunction() ? function.getFunction()(variables) : function.evaluate(variables);
+
+  if (!bitwiseEqual(result, expected)) {
+    std::ostringstream resStr, expStr;
+    resStr << std::setprecision(17) << result;
+    expStr << std::setprecision(17) << expected;
+    throw TestFailed("native " + expStr.str(), resStr.str());
+  }
+}
+
+TEST(jit_compilation) {
+  for (int i = 0; i < 300; ++i) {
+    const std::string inp = generateRandomExpression()->serialize();
+    Tester::instance().setLastQuery(inp);
+
+    auto parser = ExpressionParser::parseBuffer(inp.data(), inp.data() + inp.size());
+    assumeNative(parser.getTree());
+  }
+
+  // Deep enough to spill the stack out of the registers
+  std::string deep;
+  for (int i = 1; i < 40; ++i)
+    deep+= std::to_string(i) + (i % 2 ? "-(" : "/-(");
+  deep+= "0,5" + std::string(39, ')');
+  Tester::instance().setLastQuery(deep);
+
+  auto deepParser = ExpressionParser::parseBuffer(deep.data(), deep.data() + deep.size());
+  assumeNative(deepParser.getTree());
+
+  // Variables, including zero signs and division by zero
+  VariableTable variables;
+  const std::string withVariables = "(x - y)/(y*-z) + -(x_1 - -z)*(z/(x + y - 1))";
+  Tester::instance().setLastQuery(withVariables);
+  auto variableParser = ExpressionParser::parseBuffer(withVariables.data(), withVariables.data() + withVariables.size(), variables);
+
+  for (int i = 0; i < 1000; ++i) {
+    for (std::size_t k = 0; k < variables.size(); ++k)
+      variables.bind(k, i % 7 ? randInt(-100, 100) / 10.0 : -0.0);
+    assumeNative(variableParser.getTree(), variables.getValues());
+  }
+
+  // Equal programs share their code
+  JitCache cache(2);
+  auto program = CompiledExpression::compile(variableParser.getTree());
+  auto first = cache.get(program);
+  auto second = cache.get(CompiledExpression::compile(variableParser.getTree()));
+
+  if (first != second || cache.getHits() != 1 || cache.getMisses() != 1)
+    throw TestFailed("a cache hit", std::to_string(cache.getHits()) + " hits");
+
+  if (JitFunction::supported() != (first->getFunction() != nullptr))
+    throw TestFailed("native code where supported", "something else");
+}
+
+static_assert(Literal::evaluate("2 + 2*2") == 6, "Priorities");
+static_assert(Literal::evaluate("-2*-(3)(1,5)") == 9, "Implicit multiplication");
+static_assert(Literal::evaluate("(1)2.5 - 8/4/2") == 1.5, "Associativity");
+// Every path of the shared decimal conversion works at compile time
+static_assert(Literal::evaluate("12345678901234567") == 12345678901234567.0, "128-bit product");
+static_assert(Literal::evaluate("1,2345678901234567") == 1.2345678901234567, "128-bit quotient");
+static_assert(Literal::evaluate("0.30000000000000001665") == 0.3, "Big integers");
+
+// Compile time or not, the literal and the parser agree on everything
+void assumeLiteral(const std::string& inp) {
+  Tester::instance().setLastQuery(inp);
+
+  bool parsed = false, literal = false;
+  double expected = 0, result = 0;
+
+  try {
+    expected = ExpressionParser::parseBuffer(inp.data(), inp.data() + inp.size()).getTree().evaluate();
+    parsed = true;
+  }
+  catch (Exceptions::ParsingException&) { }
+
+  try {
+    result = Literal::evaluate(inp.c_str());
+    literal = true;
+  }
+  catch (std::invalid_argument&) { }
+
+  if (parsed != literal)
+    throw TestFailed(parsed ? "a literal" : "a syntax error", literal ? "a literal" : "a syntax error");
+
+  if (!bitwiseEqual(result, expected)) {
+    std::ostringstream resStr, expStr;
+    resStr << std::setprecision(17) << result;
+    expStr << std::setprecision(17) << expected;
+    throw TestFailed(expStr.str(), resStr.str());
+  }
+}
+
+TEST(literal_expressions) {
+  std::mt19937 random(2016);
+  static const char symbols[] = "+-*/().,0 9x$";
+
+  for (int i = 0; i < 3000; ++i) {
+    std::string inp = generateRandomExpression()->serialize();
+    assumeLiteral(inp);
+
+    // A broken one now and then
+    inp[random() % inp.size()] = symbols[random() % (sizeof(symbols) - 1)];
+    assumeLiteral(inp);
+  }
+
+  // Numbers past the fast path round the same
+  for (const std::string& number : { std::string("0,1000000000000000055511151231257827"),
+	std::string("123456789012345678901234567890"), "0," + std::string(323, '0') + "24703282292062328",
+	std::string(308, '9') + ",5", std::string("9007199254740993") })
+    assumeLiteral(number);
+
+  constexpr double ratio = Literal::evaluate("(1 + 2,5)/7");
+  if (ratio != 0.5)
+    throw TestFailed("0.5", std::to_string(ratio));
+
+  const auto area = LITERAL_EXPRESSION("(a + b)h/2");
+  if (area.variableCount != 3 || area(3, 4, 2.5) != 8.75)
+    throw TestFailed("8.75", std::to_string(area(3, 4, 2.5)));
+
+  // Variables are numbered the way VariableTable does it
+  const auto formula = LITERAL_EXPRESSION("(x - y)/(y*-z) + -(x_1 - -z)*(z/(x + y - 1))(x)");
+  const std::string text = "(x - y)/(y*-z) + -(x_1 - -z)*(z/(x + y - 1))(x)";
+  Tester::instance().setLastQuery(text);
+
+  VariableTable variables;
+  auto parser = ExpressionParser::parseBuffer(text.data(), text.data() + text.size(), variables);
+
+  for (int i = 0; i < 1000; ++i) {
+    for (std::size_t k = 0; k < variables.size(); ++k)
+      variables.bind(k, i % 7 ? static_cast<int>(random() % 201) / 10.0 - 10 : -0.0);
+
+    const double expected = parser.getTree().evaluate();
+    const double result = formula.evaluate(variables.getValues());
+
+    if (!bitwiseEqual(result, expected))
+      throw TestFailed(std::to_string(expected), std::to_string(result));
+  }
+}
+
+void assumeShared(const std::string& inp, const std::size_t nodes, const OperandType* variables = nullptr) {
+  Tester::instance().setLastQuery(inp);
+
+  VariableTable table;
+  auto parser = ExpressionParser::parseBuffer(inp.data(), inp.data() + inp.size(), table);
+  simplifyTree(parser.getTree());
+
+  const ExpressionDag dag = ExpressionDag::build(parser.getTree());
+  if (dag.getNodeCount() != nodes)
+    throw TestFailed(std::to_string(nodes) + " nodes", std::to_string(dag.getNodeCount()));
+
+  for (std::size_t k = 0; variables && k < table.size(); ++k)
+    table.bind(k, variables[k]);
+
+  const double expected = parser.getTree().evaluate();
+  const double result = dag.evaluate(table.getValues());
+
+  if (!bitwiseEqual(result, expected))
+    throw TestFailed(std::to_string(expected), std::to_string(result));
+}
+
+TEST(common_subexpressions) {
+  const double x[] = { 1, 2 };
+  assumeShared("(x + y)*(x + y) - (x + y)", 5, x);
+  assumeShared("-x*-x + -(x)", 4, x);
+  assumeShared("(x - y)/(y - x)", 5, x);
+  // Zeros of different signs are different constants
+  assumeShared("x/(0*-1) + x/0", 6, x);
+
+  // Unary pluses are nodes of the tree, even though they compute nothing
+  const std::string plus = "+(x) - +1";
+  VariableTable table;
+  auto plusParser = ExpressionParser::parseBuffer(plus.data(), plus.data() + plus.size(), table);
+  const ExpressionDag plusDag = ExpressionDag::build(plusParser.getTree());
+  if (plusDag.getTreeNodeCount() != 5 || plusDag.getNodeCount() != 3)
+    throw TestFailed("5 tree nodes in 3", std::to_string(plusDag.getTreeNodeCount()) + " in " +
+		     std::to_string(plusDag.getNodeCount()));
+
+  for (int i = 0; i < 300; ++i) {
+    // A block copied all over a formula shrinks to a single copy
+    const std::string block = generateRandomExpression()->serialize();
+    const std::string inp = block + "*" + block + "-" + block + "/(" + block + "+" + block + ")";
+    Tester::instance().setLastQuery(inp);
+
+    auto parser = ExpressionParser::parseBuffer(inp.data(), inp.data() + inp.size());
+    const ExpressionDag dag = ExpressionDag::build(parser.getTree());
+
+    auto single = ExpressionParser::parseBuffer(block.data(), block.data() + block.size());
+    const std::size_t blockNodes = ExpressionDag::build(single.getTree()).getNodeCount();
+
+    if (dag.getNodeCount() != blockNodes + 4 || dag.getTreeNodeCount() < 5 * blockNodes)
+      throw TestFailed(std::to_string(blockNodes + 4) + " nodes", std::to_string(dag.getNodeCount()));
+    if (dag.getDeduplicationRatio() < 1 || (blockNodes > 1 && !dag.getBytesSaved()))
+      throw TestFailed("less memory", std::to_string(dag.getBytesSaved()) + " bytes saved");
+
+    const double expected = parser.getTree().evaluate();
+    if (!bitwiseEqual(dag.evaluate(), expected))
+      throw TestFailed(std::to_string(expected), std::to_string(dag.evaluate()));
+  }
+}
+
+TEST(expression_library) {
+  const std::string path = "/tmp/calc-test-" + std::to_string(getpid()) + ".lib";
+  std::vector<double> expected;
+  LibraryWriter writer;
+
+  for (int i = 0; i < 500; ++i) {
+    const std::string inp = generateRandomExpression()->serialize();
+    auto parser = ExpressionParser::parseBuffer(inp.data(), inp.data() + inp.size());
+
+    writer.add(CompiledExpression::compile(parser.getTree()));
+    expected.push_back(parser.getTree().evaluate());
+  }
+
+  // Deep enough for the stack to go to the heap
+  std::string deep;
+  for (int i = 0; i < 100; ++i)
+    deep+= "1-(";
+  deep+= "x" + std::string(100, ')');
+
+  auto formula = PreparedExpression::prepare("(x - y)/(y*-z) + -(x_1 - -z)*(z/(x + y - 1))");
+  auto deepFormula = PreparedExpression::prepare(deep);
+  writer.add(formula);
+  writer.add(deepFormula);
+  writer.save(path);
+
+  {
+    const ExpressionLibrary library = ExpressionLibrary::open(path);
+    if (library.size() != expected.size() + 2)
+      throw TestFailed(std::to_string(expected.size() + 2) + " expressions", std::to_string(library.size()));
+
+    for (std::size_t i = 0; i < expected.size(); ++i)
+      if (!bitwiseEqual(library.evaluate(i), expected[i]))
+	throw TestFailed(std::to_string(expected[i]), std::to_string(library.evaluate(i)));
+
+    const std::size_t last = expected.size();
+    if (library.getVariableCount(last) != 4 || library.getVariableName(last, 3) != "x_1")
+      throw TestFailed("x_1", library.getVariableName(last, 3));
+
+    double variables[4];
+    for (int i = 0; i < 100; ++i) {
+      for (std::size_t k = 0; k < formula.getVariableCount(); ++k)
+	formula.bind(k, variables[k] = i % 7 ? randInt(-100, 100) / 10.0 : -0.0);
+      deepFormula.bind(0, variables[0]);
+
+      if (!bitwiseEqual(library.evaluate(last, variables), formula.evaluate()))
+	throw TestFailed(std::to_string(formula.evaluate()), std::to_string(library.evaluate(last, variables)));
+      if (!bitwiseEqual(library.evaluate(last + 1, variables), deepFormula.evaluate()))
+	throw TestFailed(std::to_string(deepFormula.evaluate()), std::to_string(library.evaluate(last + 1, variables)));
+    }
+  }
+
+  // Damage anywhere past the header is caught by the checksum
+  std::FILE* file = std::fopen(path.c_str(), "r+b");
+  std::fseek(file, sizeof(LibraryFormat::Header) + 1000, SEEK_SET);
+  std::fputc(0x7f, file);
+  std::fclose(file);
+
+  bool refused = false;
+  try {
+    ExpressionLibrary::open(path);
+  }
+  catch (std::runtime_error&) {
+    refused = true;
+  }
+
+  // A truncated file is refused even unverified
+  bool truncated = false;
+  if (truncate(path.c_str(), 4000) == 0) {
+    try {
+      ExpressionLibrary::open(path, false);
+    }
+    catch (std::runtime_error&) {
+      truncated = true;
+    }
+  }
+
+  unlink(path.c_str());
+
+  if (!refused || !truncated)
+    throw TestFailed("damaged libraries refused", "a library opened");
+}
+
+TEST(arena_allocation) {
+  NodeArena arena;
+  const std::string inp = "1 + 2.5(3 + 5) - -3*4/(7-1)";
+  Tester::instance().setLastQuery(inp);
+
+  for (int i = 0; i < 1000; ++i) {
+    arena.reset();
+
+    std::istringstream stream(inp);
+    auto parser = ExpressionParser::parseStream(stream, arena);
+    if (parser.getTree().evaluate() != 23)
+      throw TestFailed("23", std::to_string(parser.getTree().evaluate()));
+  }
+
+  // Everything after the first expression reuses the same block
+  if (arena.getHeapAllocations() != 1)
+    throw TestFailed("a single heap allocation", std::to_string(arena.getHeapAllocations()));
+}
+
+TEST(buffer_parsing) {
+  const std::string input = "2*2\n(2+3)(7+1)\n\n1/4";
+  Tester::instance().setLastQuery(input);
+
+  const char* pos = input.data();
+  const char* end = pos + input.size();
+  std::vector<double> results;
+
+  while (pos != end) {
+    auto parser = ExpressionParser::parseBuffer(pos, end);
+    if (!parser.nothingRead())
+      results.push_back(parser.getTree().evaluate());
+
+    pos = parser.getPosition();
+  }
+
+  const std::vector<double> expected = {4, 40, 0.25};
+  if (results != expected)
+    throw TestFailed("3 results", std::to_string(results.size()) + " results");
+
+  // Error positions are counted from the start of the range
+  const std::string bad = "1+1\n(2+3\n5";
+  try {
+    ExpressionParser::parseBuffer(bad.data() + 4, bad.data() + bad.size());
+    throw TestFailed("an exception", "a result");
+  }
+  catch (Exceptions::UnexpectedExpressionEnd& e) {
+    Exceptions::UnexpectedExpressionEnd ass;
+    ass.movePos(5);
+
+    if (ass.what() != e.what())
+      throw TestFailed(ass.what(), e.what());
+  }
+}
+
+TEST(deep_nesting) {
+  const std::size_t depth = 100000;
+  assumeResult(std::string(depth, '(') + "2" + std::string(depth, ')') + "(3)", 6);
+  assumeException<Exceptions::UnexpectedExpressionEnd>(std::string(depth, '(') + "2+\n", depth + 2);
+  assumeException<Exceptions::UnexpectedExpressionEnd>("2*(" + std::string(depth, '(') + ")", depth + 3);
+
+  // Closed parentheses are reused, the arena grows as for the bare terms
+  std::string bare = "0", braced = "(0)";
+  for (int i = 0; i < 20000; ++i) {
+    bare+= "+1";
+    braced+= "+(1)";
+  }
+
+  NodeArena bareArena, bracedArena;
+  ExpressionParser::parseBuffer(bare.data(), bare.data() + bare.size(), bareArena);
+  auto parser = ExpressionParser::parseBuffer(braced.data(), braced.data() + braced.size(), bracedArena);
+
+  if (parser.getTree().evaluate() != 20000)
+    throw TestFailed("20000", std::to_string(parser.getTree().evaluate()));
+
+  if (bracedArena.getBytesReserved() != bareArena.getBytesReserved())
+    throw TestFailed(std::to_string(bareArena.getBytesReserved()) + " bytes", std::to_string(bracedArena.getBytesReserved()));
+}
+
+TEST(huge_trees) {
+  const std::size_t terms = 3000000;
+
+  std::string leftDeep = "1";
+  for (std::size_t i = 1; i < terms; ++i)
+    leftDeep+= "+1";
+  assumeResult(leftDeep, terms);
+
+  std::string rightDeep;
+  for (std::size_t i = 1; i < terms; ++i)
+    rightDeep+= "1-(";
+  rightDeep+= "1" + std::string(terms - 1, ')');
+  assumeResult(rightDeep, terms % 2 ? 1 : 0);
+
+  assumeResult(std::string(terms, '-') + "1", terms % 2 ? -1 : 1);
+}
+
+TEST(incremental_evaluation) {
+  const std::string inp = "1 + 2*3 - (4 + 5)/2";
+  Tester::instance().setLastQuery(inp);
+
+  auto parser = ExpressionParser::parseBuffer(inp.data(), inp.data() + inp.size());
+  EvaluationTree& tree = parser.getTree();
+  const std::vector<Leaf*> leaves = tree.getLeaves();
+
+  if (leaves.size() != 6 || leaves[1]->getValue() != 2 || tree.evaluate() != 2.5)
+    throw TestFailed("6 leaves and 2.5", std::to_string(leaves.size()) + " leaves");
+
+  // Only the path of the changed operand goes dirty
+  leaves[1]->setValue(10);
+  if (!tree.getRoot()->isDirty() || leaves[3]->getParent()->isDirty())
+    throw TestFailed("a dirty path", "dirty flags elsewhere");
+  if (tree.evaluate() != 26.5 || tree.getRoot()->isDirty())
+    throw TestFailed("26.5", std::to_string(tree.evaluate()));
+
+  // Variables are evaluated every time
+  VariableTable variables;
+  const std::string withVariable = "x*(2 + 3)";
+  auto variableParser = ExpressionParser::parseBuffer(withVariable.data(), withVariable.data() + withVariable.size(), variables);
+
+  for (const double x : { 1.0, 2.0, -4.0 }) {
+    variables.bind(variables.find("x"), x);
+    if (variableParser.getTree().evaluate() != 5 * x)
+      throw TestFailed(std::to_string(5 * x), std::to_string(variableParser.getTree().evaluate()));
+  }
+
+  // Random updates against compiling the tree from scratch
+  for (int i = 0; i < 50; ++i) {
+    const std::string random = generateRandomExpression()->serialize();
+    Tester::instance().setLastQuery(random);
+
+    auto randomParser = ExpressionParser::parseBuffer(random.data(), random.data() + random.size());
+    EvaluationTree& randomTree = randomParser.getTree();
+    const std::vector<Leaf*> randomLeaves = randomTree.getLeaves();
+
+    for (int update = 0; update < 20; ++update) {
+      randomLeaves[randInt(0, randomLeaves.size() - 1)]->setValue(randInt(-1000, 1000) / 10.0);
+
+      const double incremental = randomTree.evaluate();
+      const double full = CompiledExpression::compile(randomTree).evaluate();
+      if (!bitwiseEqual(incremental, full))
+	throw TestFailed(std::to_string(full), std::to_string(incremental));
+    }
+  }
+}
+
+TEST(prepared_expressions) {
+  const std::string inp = "x*(y + 1) - 2,5*x + (y)z_1/4";
+  Tester::instance().setLastQuery(inp);
+
+  auto expr = PreparedExpression::prepare(inp);
+  if (expr.getVariableCount() != 3)
+    throw TestFailed("3 variables", std::to_string(expr.getVariableCount()));
+
+  const std::size_t x = expr.getVariableIndex("x");
+  const std::size_t y = expr.getVariableIndex("y");
+  const std::size_t z = expr.getVariableIndex("z_1");
+
+  expr.bind(x, 2);
+  expr.bind(y, 3);
+  expr.bind(z, 4);
+
+  // 2*4 - 2.5*2 + 3*4/4
+  if (expr.evaluate() != 6)
+    throw TestFailed("6", std::to_string(expr.evaluate()));
+
+  // Every row of the columns must match the tree with the same bindings
+  const std::size_t rows = 1000;
+  std::vector<std::vector<double>> columns(3, std::vector<double>(rows));
+  for (auto& column : columns)
+    for (auto& value : column)
+      value = static_cast<double>(randInt(-100, 100)) / 10.0;
+
+  for (const std::string& columnInp : { std::string("x*(y + 1) - 2,5*x + (y)z/4"),
+					std::string("-x/-(y-z) - -(1/z)"),
+					std::string("y") }) {
+    Tester::instance().setLastQuery(columnInp);
+    auto columnExpr = PreparedExpression::prepare(columnInp);
+
+    // Columns are passed in the order of variable indices
+    std::vector<const double*> columnPtrs;
+    for (std::size_t k = 0; k < columnExpr.getVariableCount(); ++k)
+      columnPtrs.push_back(columns[columnExpr.getVariableName(k)[0] - 'x'].data());
+
+    for (const auto kernels : supportedColumnKernels()) {
+      for (const std::size_t blockSize : { 1, 7, 256 }) {
+	std::vector<double> results(rows);
+	columnExpr.evaluateColumns(columnPtrs.data(), rows, results.data(), *kernels, blockSize);
+
+	for (std::size_t i = 0; i < rows; ++i) {
+	  for (std::size_t k = 0; k < columnPtrs.size(); ++k)
+	    columnExpr.bind(k, columnPtrs[k][i]);
+
+	  if (!bitwiseEqual(results[i], columnExpr.getTree().evaluate()))
+	    throw TestFailed(std::to_string(columnExpr.getTree().evaluate()) + " from the tree",
+			     std::to_string(results[i]) + " from " + kernels->name);
+	}
+      }
+    }
+  }
+
+  // Blocks of no rows would never get through the columns
+  try {
+    std::vector<double> results(rows);
+    const double* column = columns[0].data();
+    PreparedExpression::prepare("x + 1").evaluateColumns(&column, rows, results.data(), bestColumnKernels(), 0);
+    throw TestFailed("an exception", "a result");
+  }
+  catch (std::invalid_argument&) { }
+
+  // Identifiers follow the usual rules for operands
+  try {
+    PreparedExpression::prepare("2 x");
+    throw TestFailed("an exception", "a result");
+  }
+  catch (UnexpectedOperand&) { }
 }
 
 TEST(randomized_tests) {
@@ -317,6 +798,810 @@ TEST(randomized_tests) {
   std::cout << std::endl;
 }
 
+TEST(batch_mode) {
+  std::string input;
+  for (int i = 0; i < 20000; ++i) {
+    switch (i % 7) {
+    case 3: input+= "2+3 7"; break;
+    case 5: input+= "   "; break;
+    default: input+= generateRandomExpression()->serialize();
+    }
+    input.push_back('\n');
+  }
+  input+= "(1+2";
+
+  std::ostringstream serialOut, serialErr;
+  evaluateBatch(input.data(), input.data() + input.size(), 1, serialOut, serialErr);
+
+  std::ostringstream parallelOut, parallelErr;
+  evaluateBatch(input.data(), input.data() + input.size(), 8, parallelOut, parallelErr);
+
+  if (serialOut.str() != parallelOut.str())
+    throw TestFailed("same results from 8 threads", "a different output");
+
+  if (serialErr.str() != parallelErr.str())
+    throw TestFailed("same errors from 8 threads", "different errors");
+
+  // Each error position is counted from its own line
+  UnexpectedOperand operand;
+  operand.movePos(5);
+  UnexpectedExpressionEnd end;
+  end.movePos(4);
+
+  std::string expectedErr;
+  for (int i = 3; i < 20000; i+= 7)
+    expectedErr+= operand.what() + "\n";
+  expectedErr+= end.what() + "\n";
+
+  if (parallelErr.str() != expectedErr)
+    throw TestFailed("per-line error positions", "something else");
+}
+
+TEST(result_cache) {
+  const std::string spaced = " \t1 +  2\t(3)  \n";
+  std::string key;
+  ResultCache::normalize(spaced.data(), spaced.data() + spaced.size(), key);
+
+  if (key != "1+2(3)")
+    throw TestFailed("'1+2(3)'", "'" + key + "'");
+
+  const std::string separated = "1  2,5 \n";
+  ResultCache::normalize(separated.data(), separated.data() + separated.size(), key);
+
+  if (key != "1 2,5")
+    throw TestFailed("'1 2,5'", "'" + key + "'");
+
+  ResultCache cache(2);
+  double value;
+  cache.insert("a", 1);
+  cache.insert("b", 2);
+  cache.find("a", value);  // b is the least recently used now
+  cache.insert("c", 3);
+
+  if (cache.find("b", value) || !cache.find("a", value) || value != 1 || !cache.find("c", value))
+    throw TestFailed("b evicted", "something else");
+
+  if (cache.getHits() != 3 || cache.getMisses() != 1 || cache.getEvictions() != 1)
+    throw TestFailed("3 hits, 1 miss, 1 eviction", std::to_string(cache.getHits()) + " hits, " +
+		     std::to_string(cache.getMisses()) + " misses, " +
+		     std::to_string(cache.getEvictions()) + " evictions");
+
+  // The memory bound holds whatever the entry count
+  ResultCache small(0, 1024);
+  for (int i = 0; i < 1000; ++i)
+    small.insert(std::to_string(i), i);
+
+  if (small.getBytes() > 1024 || small.size() == 0 || small.getEvictions() == 0)
+    throw TestFailed("at most 1024 bytes", std::to_string(small.getBytes()));
+
+  // Cached lines print the same as parsed ones, errors keep their positions
+  const std::string input = "1 + 2*3\n1+2*3\n  1 +  2 * 3  \n1 2\n1  2\n\n(1)/8\n";
+  Tester::instance().setLastQuery(input);
+
+  LineEvaluator plain;
+  LineEvaluator cached(16, 0);
+  std::string plainText, cachedText;
+
+  for (const char *p = input.data(), *c = p, *end = p + input.size(); p != end;) {
+    const auto plainOutcome = plain.evaluateLine(p, end, plainText);
+    const auto cachedOutcome = cached.evaluateLine(c, end, cachedText);
+
+    if (plainOutcome != cachedOutcome || p != c ||
+	(plainOutcome != LineEvaluator::Outcome::Nothing && plainText != cachedText))
+      throw TestFailed("'" + plainText + "'", "'" + cachedText + "'");
+  }
+
+  if (cached.getCache()->getHits() != 2 || cached.getCache()->size() != 2)
+    throw TestFailed("2 hits", std::to_string(cached.getCache()->getHits()));
+}
+
+std::size_t countNodes(const TreeNode* node) {
+  switch (node->getKind()) {
+  case NodeKind::Root: {
+    const TreeNode* child = static_cast<const RootNode*>(node)->getChild();
+    return 1 + (child ? countNodes(child) : 0);
+  }
+  case NodeKind::Unary:
+    return 1 + countNodes(static_cast<const UnaryNode*>(node)->getChild());
+  case NodeKind::Binary:
+    return 1 + countNodes(static_cast<const BinaryNode*>(node)->getLeftChild())
+      + countNodes(static_cast<const BinaryNode*>(node)->getRightChild());
+  default:
+    return 1;
+  }
+}
+
+void assumeSimplified(const std::string& inp, const std::size_t removed) {
+  Tester::instance().setLastQuery(inp);
+
+  VariableTable variables;
+  auto original = ExpressionParser::parseBuffer(inp.data(), inp.data() + inp.size(), variables);
+  auto simplified = ExpressionParser::parseBuffer(inp.data(), inp.data() + inp.size(), variables);
+
+  const std::size_t nodes = countNodes(simplified.getTree().getRoot());
+  const std::size_t reported = simplifyTree(simplified.getTree());
+
+  if (reported != removed)
+    throw TestFailed(std::to_string(removed) + " nodes removed", std::to_string(reported));
+  if (countNodes(simplified.getTree().getRoot()) != nodes - removed)
+    throw TestFailed(std::to_string(nodes - removed) + " nodes left",
+		     std::to_string(countNodes(simplified.getTree().getRoot())));
+
+  // Zeros of both signs and IEEE specials are where rewrites would show
+  const double values[] = { 0.0, -0.0, 1.0, -2.5, 1.0/0.0, -1.0/0.0, std::nan("") };
+  for (const double x : values) {
+    for (const double y : values) {
+      if (variables.size() > 0)
+	variables.bind(0, x);
+      if (variables.size() > 1)
+	variables.bind(1, y);
+
+      const double expected = original.getTree().evaluate();
+      const double result = simplified.getTree().evaluate();
+
+      if (!bitwiseEqual(expected, result))
+	throw TestFailed(std::to_string(expected), std::to_string(result));
+    }
+  }
+}
+
+TEST(statistics) {
+  const std::string input = "1+2\n\n(3)*4\n2+\n2 3\n1+2\n5$\n2)\n";
+  Tester::instance().setLastQuery(input);
+
+  Statistics stats;
+  LineEvaluator evaluator(16, 0);
+  evaluator.setStatistics(&stats);
+
+  std::string text;
+  for (const char* pos = input.data(); pos != input.data() + input.size(); )
+    evaluator.evaluateLine(pos, input.data() + input.size(), text);
+
+  // The repeated line comes from the cache; "(3)*4" keeps one group node
+  const std::vector<std::pair<Statistics::Counter, std::uint64_t>> expected = {
+    { Statistics::Lines, 8 }, { Statistics::Expressions, 3 }, { Statistics::CacheHits, 1 },
+    { Statistics::UnexpectedOperands, 1 }, { Statistics::UnexpectedEnds, 1 },
+    { Statistics::UnexpectedSymbols, 1 }, { Statistics::BadSymbols, 1 }
+  };
+
+  for (const auto& counter : expected)
+    if (stats.get(counter.first) != counter.second)
+      throw TestFailed(std::to_string(counter.second) + " for counter " + std::to_string(counter.first),
+		       std::to_string(stats.get(counter.first)));
+
+  if (stats.get(Statistics::NodesBuilt) < 12 || stats.get(Statistics::ParseTime) == 0)
+    throw TestFailed("nodes and parse time counted", stats.summary());
+
+  // Merging adds up
+  Statistics total;
+  total.merge(stats);
+  total.merge(stats);
+  if (total.get(Statistics::Lines) != 16)
+    throw TestFailed("16 lines", std::to_string(total.get(Statistics::Lines)));
+}
+
+int connectTo(const std::string& path) {
+  sockaddr_un address;
+  std::memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  std::strcpy(address.sun_path, path.c_str());
+
+  const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0 || connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)))
+    throw TestFailed("a connection to " + path, std::strerror(errno));
+
+  return fd;
+}
+
+void writeAll(const int fd, const std::string& data) {
+  for (std::size_t done = 0; done < data.size(); ) {
+    const ssize_t length = write(fd, data.data() + done, data.size() - done);
+    if (length <= 0)
+      throw TestFailed("the request sent", std::strerror(errno));
+    done+= length;
+  }
+}
+
+std::string readAll(const int fd) {
+  std::string result;
+  char buffer[4096];
+  ssize_t length;
+
+  while ((length = read(fd, buffer, sizeof(buffer))) > 0)
+    result.append(buffer, length);
+
+  return result;
+}
+
+TEST(socket_server) {
+  const std::string path = "/tmp/calc-test-" + std::to_string(getpid()) + ".sock";
+
+  CalcServer::Limits limits;
+  limits.maxConnections = 16;
+  limits.maxPendingOutput = 4096;
+
+  CalcServer server(path, limits, 64, 0);
+  std::thread serving([&server]() { server.run(); });
+
+  Exceptions::UnexpectedExpressionEnd end;
+  end.movePos(3);
+  const std::string request = "1+1\n2*3\n\n(1+\n 2,5 \n";
+  const std::string response = "2\n6\n" + end.what() + "\n2.5\n";
+  Tester::instance().setLastQuery(request);
+
+  try {
+    // Many more clients than connections, each one pipelining its lines
+    std::vector<int> clients;
+    for (int i = 0; i < 200; ++i) {
+      clients.push_back(connectTo(path));
+      writeAll(clients.back(), request);
+      shutdown(clients.back(), SHUT_WR);
+    }
+
+    for (const int fd : clients) {
+      const std::string answer = readAll(fd);
+      close(fd);
+
+      if (answer != response)
+	throw TestFailed(response, answer);
+    }
+
+    // Lines split across writes, the last one unterminated
+    const int split = connectTo(path);
+    writeAll(split, "1 +");
+    writeAll(split, " 2\n3");
+    writeAll(split, "*4");
+    shutdown(split, SHUT_WR);
+
+    const std::string answer = readAll(split);
+    close(split);
+    if (answer != "3\n12\n")
+      throw TestFailed("3 and 12", answer);
+
+    // Far more output than the server buffers, read while being written
+    const int bulk = connectTo(path);
+    std::string lines;
+    for (int i = 0; i < 100000; ++i)
+      lines+= std::to_string(i) + "/4\n";
+
+    std::thread writer([&]() {
+	writeAll(bulk, lines);
+	shutdown(bulk, SHUT_WR);
+      });
+    const std::string results = readAll(bulk);
+    writer.join();
+    close(bulk);
+
+    std::string expected;
+    for (int i = 0; i < 100000; ++i)
+      expected+= formatDouble(i / 4.0) + "\n";
+    if (results != expected)
+      throw TestFailed(std::to_string(expected.size()) + " bytes of results", std::to_string(results.size()));
+
+    // Out of descriptors with no one connected, the server waits it out
+    const int waiting = socket(AF_UNIX, SOCK_STREAM, 0);
+    const int lowestFree = dup(0);
+    close(lowestFree);
+
+    rlimit descriptors;
+    getrlimit(RLIMIT_NOFILE, &descriptors);
+    rlimit exhausted = descriptors;
+    exhausted.rlim_cur = lowestFree;
+    setrlimit(RLIMIT_NOFILE, &exhausted);
+
+    sockaddr_un address;
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    std::strcpy(address.sun_path, path.c_str());
+    const int connected = connect(waiting, reinterpret_cast<sockaddr*>(&address), sizeof(address));
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(250));
+    setrlimit(RLIMIT_NOFILE, &descriptors);
+
+    if (connected)
+      throw TestFailed("a connection to " + path, std::strerror(errno));
+    writeAll(waiting, "3*3\n");
+    shutdown(waiting, SHUT_WR);
+    const std::string waited = readAll(waiting);
+    close(waiting);
+    if (waited != "9\n")
+      throw TestFailed("9", waited);
+
+    // A socket in use is left alone
+    try {
+      CalcServer second(path, limits);
+      throw TestFailed("an exception", "a second server");
+    }
+    catch (std::system_error& e) {
+      if (e.code().value() != EADDRINUSE)
+	throw TestFailed("EADDRINUSE", e.what());
+    }
+
+    const int after = connectTo(path);
+    writeAll(after, "2+2\n");
+    shutdown(after, SHUT_WR);
+    const std::string stillServed = readAll(after);
+    close(after);
+    if (stillServed != "4\n")
+      throw TestFailed("4", stillServed);
+  }
+  catch (...) {
+    server.stop();
+    serving.join();
+    throw;
+  }
+
+  server.stop();
+  serving.join();
+
+  // A socket nobody listens on is replaced
+  const std::string stalePath = path + ".stale";
+  sockaddr_un address;
+  std::memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  std::strcpy(address.sun_path, stalePath.c_str());
+
+  const int stale = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (stale < 0 || bind(stale, reinterpret_cast<sockaddr*>(&address), sizeof(address)))
+    throw TestFailed("a stale socket", std::strerror(errno));
+  close(stale);
+
+  CalcServer replacing(stalePath, limits);
+}
+
+TEST(pipeline) {
+  // The queue keeps the order while the threads race
+  SpscQueue<int> queue(64);
+  std::thread producer([&queue]() {
+      for (int i = 0; i < 1000000; ++i)
+	queue.push(std::move(i));
+    });
+
+  int value;
+  for (int i = 0; i < 1000000; ++i) {
+    queue.pop(value);
+    if (value != i) {
+      producer.join();
+      throw TestFailed(std::to_string(i), std::to_string(value));
+    }
+  }
+  producer.join();
+
+  // Lines of every kind, more than a few blocks of them
+  std::string input;
+  for (int i = 0; i < 30000; ++i) {
+    switch (i % 10) {
+    case 3: input+= "2 + * 3\n"; break;
+    case 4: input+= "  \n"; break;
+    case 5: input+= "1/(3 - 3)$\n"; break;
+    default: input+= generateRandomExpression()->serialize() + "\n";
+    }
+  }
+  input+= "(1 + 2)*3";
+
+  std::string expected, text;
+  LineEvaluator serial;
+  for (const char* pos = input.data(); pos != input.data() + input.size(); )
+    if (serial.evaluateLine(pos, input.data() + input.size(), text) != LineEvaluator::Outcome::Nothing)
+      expected+= text + "\n";
+
+  for (const unsigned evaluators : { 1, 3 }) {
+    // Both streams into one pipe show how they interleave
+    int in[2], out[2];
+    if (pipe(in) || pipe(out))
+      throw TestFailed("pipes", std::strerror(errno));
+
+    std::thread writer([&]() {
+	writeAll(in[1], input);
+	close(in[1]);
+      });
+
+    std::string output;
+    std::thread reader([&]() {
+	output = readAll(out[0]);
+      });
+
+    const PipelineReport report = evaluatePipeline(in[0], out[1], out[1], evaluators, 16);
+    close(out[1]);
+    writer.join();
+    reader.join();
+    close(in[0]);
+    close(out[0]);
+
+    if (output != expected)
+      throw TestFailed(std::to_string(expected.size()) + " bytes in serial order", std::to_string(output.size()));
+    if (report.lines != 30001 || report.latency.getCount() != 30001)
+      throw TestFailed("30001 lines", std::to_string(report.lines));
+    if (report.latency.percentile(50) > report.latency.percentile(99))
+      throw TestFailed("ordered percentiles", report.summary());
+  }
+}
+
+TEST(parallel_evaluation) {
+  static const char operators[] = "+-*/";
+  WorkStealingPool pool(4);
+
+  // Random blocks joined at random, so that the tree is of any shape
+  std::string inp = generateRandomExpression()->serialize();
+  for (int i = 0; i < 3000; ++i) {
+    inp.push_back(operators[std::rand() % 4]);
+    inp+= generateRandomExpression()->serialize();
+  }
+
+  auto serial = ExpressionParser::parseBuffer(inp.data(), inp.data() + inp.size());
+  auto parser = ExpressionParser::parseBuffer(inp.data(), inp.data() + inp.size());
+  ParallelEvaluation parallel(parser.getTree(), 64);
+
+  if (!parallel.getTaskCount())
+    throw TestFailed("tasks", "a serial plan");
+
+  // Leaves changed between runs get evaluated anew along with their paths
+  const auto serialLeaves = serial.getTree().getLeaves();
+  const auto leaves = parser.getTree().getLeaves();
+  for (int i = 0; i < 20; ++i) {
+    const double expected = serial.getTree().evaluate();
+    const double result = parallel.evaluate(pool);
+    if (!bitwiseEqual(result, expected))
+      throw TestFailed(std::to_string(expected), std::to_string(result));
+
+    const std::size_t leaf = std::rand() % leaves.size();
+    serialLeaves[leaf]->setValue(i);
+    leaves[leaf]->setValue(i);
+  }
+
+  // Only a balanced chain splits; its halves are summed in another order
+  const std::string chain = "10000000000000000 + 1 + 1 + 1";
+  auto left = ExpressionParser::parseBuffer(chain.data(), chain.data() + chain.size());
+  auto balanced = ExpressionParser::parseBuffer(chain.data(), chain.data() + chain.size());
+
+  if (balanceChains(balanced.getTree()) != 1)
+    throw TestFailed("a chain balanced", "none");
+  if (left.getTree().evaluate() != 1e16 || balanced.getTree().evaluate() != 1e16 + 2)
+    throw TestFailed("1e16 from the left and 1e16 + 2 balanced", std::to_string(balanced.getTree().evaluate()));
+
+  // The exact sum is kept in hundredths
+  std::string sum = "1";
+  long long hundredths = 100;
+  for (int i = 0; i < 100000; ++i) {
+    const int term = randInt(1, 1000);
+    sum+= std::string(i % 1000 ? "+" : "+2*3*4*5*") + std::to_string(term) + ",37";
+    hundredths+= (term * 100 + 37) * (i % 1000 ? 1 : 120);
+  }
+
+  auto sumLeft = ExpressionParser::parseBuffer(sum.data(), sum.data() + sum.size());
+  auto sumBalanced = ExpressionParser::parseBuffer(sum.data(), sum.data() + sum.size());
+  if (ParallelEvaluation(sumLeft.getTree(), 64).getTaskCount())
+    throw TestFailed("a single spine", "tasks");
+
+  if (balanceChains(sumBalanced.getTree()) != 101)
+    throw TestFailed("101 chains balanced", "fewer");
+
+  auto sumSerial = ExpressionParser::parseBuffer(sum.data(), sum.data() + sum.size());
+  balanceChains(sumSerial.getTree());
+
+  ParallelEvaluation sumParallel(sumBalanced.getTree(), 64);
+  const double expected = sumLeft.getTree().evaluate();
+  const double result = sumParallel.evaluate(pool);
+
+  if (!bitwiseEqual(result, sumSerial.getTree().evaluate()))
+    throw TestFailed(std::to_string(sumSerial.getTree().evaluate()), std::to_string(result));
+
+  // Pairwise sums round off less than running ones
+  const double exact = hundredths / 100.0;
+  if (std::abs(result - exact) > std::abs(expected - exact) || std::abs(result - exact) > 1e-10 * exact)
+    throw TestFailed(std::to_string(exact), std::to_string(result) + " balanced, " + std::to_string(expected) + " from the left");
+}
+
+// The result or the error message, and where the next line starts
+template <typename Evaluate>
+std::string describeOutcome(const std::string& inp, Evaluate evaluate) {
+  std::ostringstream outcome;
+
+  try {
+    const char* pos = inp.data();
+    outcome << std::setprecision(17) << evaluate(pos) << " up to " << pos - inp.data();
+  }
+  catch (Exceptions::ParsingException& e) {
+    outcome << e.what();
+  }
+
+  return outcome.str();
+}
+
+void assumeStreamed(const std::string& inp) {
+  Tester::instance().setLastQuery(inp);
+  const char* end = inp.data() + inp.size();
+
+  const std::string expected = describeOutcome(inp, [end](const char*& pos) {
+      auto parser = ExpressionParser::parseBuffer(pos, end);
+      pos = parser.getPosition();
+      return parser.nothingRead() ? 0 : parser.getTree().evaluate();
+    });
+
+  const std::string result = describeOutcome(inp, [end](const char*& pos) {
+      const StreamingEvaluator evaluator = StreamingEvaluator::evaluateBuffer(pos, end);
+      pos = evaluator.getPosition();
+      return evaluator.getResult();
+    });
+
+  if (result != expected)
+    throw TestFailed(expected, result);
+}
+
+TEST(streaming_evaluation) {
+  std::mt19937 random(2016);
+  static const char symbols[] = "+-*/().,0 9x\n";
+
+  for (const char* inp : { "", "\n", "2*2\n3", "-2*-3", "2(3)4", "(2)(3)", "--2", "2*", "*2", "()", "(2", "2)",
+	"2 2", "2..5", ".", "2 + x1", "((2)+)", "1/0", "-0*1" })
+    assumeStreamed(inp);
+
+  for (int i = 0; i < 3000; ++i) {
+    std::string inp = generateRandomExpression()->serialize();
+    assumeStreamed(inp);
+
+    // Errors at every kind of place, with the same positions
+    inp[random() % inp.size()] = symbols[random() % (sizeof(symbols) - 1)];
+    assumeStreamed(inp);
+  }
+
+  const std::size_t depth = 100000;
+  assumeStreamed(std::string(depth, '(') + "2" + std::string(depth, ')') + "(3)");
+  assumeStreamed(std::string(depth, '-') + "1");
+
+  // A sum takes no more room than its first terms
+  std::string sum = "1";
+  for (std::size_t i = 1; i < 1000000; ++i)
+    sum+= i % 2 ? "+1*2" : "-(1)";
+
+  const StreamingEvaluator evaluator = StreamingEvaluator::evaluateBuffer(sum.data(), sum.data() + sum.size());
+  if (evaluator.getResult() != 500002 || evaluator.getMaxDepth() > 2)
+    throw TestFailed("500002 at depth 2", std::to_string(evaluator.getResult()) + " at depth " +
+		     std::to_string(evaluator.getMaxDepth()));
+
+  // A mapped file prints what the serial mode would
+  std::string input;
+  for (int i = 0; i < 2000; ++i) {
+    input+= generateRandomExpression()->serialize();
+    if (i % 10 == 0)
+      input[input.size() - 1 - random() % 5] = symbols[random() % (sizeof(symbols) - 1)];
+    input+= i % 100 ? "\n" : "\n \n";
+  }
+  input+= "2+2";
+
+  const std::string path = "/tmp/calc-test-" + std::to_string(getpid()) + ".txt";
+  {
+    std::ofstream file(path);
+    file << input;
+  }
+
+  LineEvaluator lineEvaluator;
+  std::vector<OutputSegment> segments;
+  evaluateChunk(input.data(), input.data() + input.size(), lineEvaluator, segments);
+
+  std::string expected;
+  for (const auto& segment : segments)
+    expected+= segment.text;
+
+  std::ostringstream output;
+  {
+    const MappedFile file(path);
+    evaluateStreaming(file.begin(), file.end(), output, output);
+  }
+  unlink(path.c_str());
+
+  if (output.str() != expected)
+    throw TestFailed("the serial output", output.str().substr(0, 200));
+}
+
+TEST(compact_trees) {
+  std::mt19937 random(2016);
+  static const char symbols[] = "+-*/().,0 9x\n";
+
+  auto assumeCompact = [](const std::string& inp) {
+    Tester::instance().setLastQuery(inp);
+    const char* end = inp.data() + inp.size();
+
+    const std::string expected = describeOutcome(inp, [end](const char*& pos) {
+	auto parser = ExpressionParser::parseBuffer(pos, end);
+	pos = parser.getPosition();
+	return parser.nothingRead() ? 0 : parser.getTree().evaluate();
+      });
+
+    const std::string result = describeOutcome(inp, [end](const char*& pos) {
+	const CompactTree tree = CompactTree::parse(pos, end);
+	return tree.getNodeCount() ? tree.evaluate() : 0;
+      });
+
+    if (result != expected)
+      throw TestFailed(expected, result);
+  };
+
+  for (int i = 0; i < 3000; ++i) {
+    std::string inp = generateRandomExpression()->serialize();
+    assumeCompact(inp);
+
+    inp[random() % inp.size()] = symbols[random() % (sizeof(symbols) - 1)];
+    assumeCompact(inp);
+  }
+  assumeCompact(std::string(100000, '(') + "2" + std::string(100000, ')') + "(-3)");
+
+  // Children come first, pluses and parentheses leave nothing behind
+  const std::string inp = "+(1) - 2*-(3)\n";
+  const char* pos = inp.data();
+  const CompactTree tree = CompactTree::parse(pos, inp.data() + inp.size());
+  const std::uint32_t root = tree.getRoot();
+  const std::uint32_t product = tree.getRight(root);
+
+  if (pos != inp.data() + inp.size() || tree.getNodeCount() != 6 || tree.getOpCode(root) != OpCode::Subtract
+      || tree.getOpCode(tree.getLeft(root)) != OpCode::Push || tree.getOpCode(product) != OpCode::Multiply
+      || tree.getOpCode(tree.getRight(product)) != OpCode::Negate || tree.getConstants()[2] != 3)
+    throw TestFailed("1 - 2*-3 in 6 nodes", std::to_string(tree.getNodeCount()) + " nodes");
+
+  if (tree.getBytes() != 6 * 9 + 3 * sizeof(double))
+    throw TestFailed("9 bytes a node and 8 a constant", std::to_string(tree.getBytes()) + " bytes");
+
+  CompactTree updated = tree;
+  updated.setConstant(0, 5);
+  if (updated.evaluate() != 11)
+    throw TestFailed("11", std::to_string(updated.evaluate()));
+
+  // A long sum waits on two values at a time, however many terms it has
+  std::string sum = "1";
+  for (int i = 1; i < 100000; ++i)
+    sum+= "+1";
+
+  const char* sumPos = sum.data();
+  const CompactTree sumTree = CompactTree::parse(sumPos, sum.data() + sum.size());
+  if (sumTree.getStackDepth() != 2 || sumTree.evaluate() != 100000)
+    throw TestFailed("100000 at depth 2", std::to_string(sumTree.evaluate()) + " at depth " +
+		     std::to_string(sumTree.getStackDepth()));
+}
+
+TEST(simplification) {
+  assumeSimplified("2*3 + x", 2);
+  assumeSimplified("--x", 2);
+  assumeSimplified("-+-+x", 4);
+  assumeSimplified("x*1 + 1*y", 4);
+  assumeSimplified("x(1)", 2);
+  assumeSimplified("(x)(2)(0,5)", 0);
+  assumeSimplified("x((2)(0,5))", 4);
+  assumeSimplified("x/1 - 0", 4);
+  assumeSimplified("x + -(2*3)", 3);
+  assumeSimplified("-0 + x + -0", 6);
+
+  // These would change the sign of zero
+  assumeSimplified("x + 0", 0);
+  assumeSimplified("0 + x", 0);
+  assumeSimplified("x - -0", 1);
+  assumeSimplified("0 - x", 0);
+  assumeSimplified("x - -y", 0);
+
+  // Constant expressions fold into a single leaf
+  for (int i = 0; i < 100; ++i) {
+    const std::string inp = generateRandomExpression()->serialize();
+    std::istringstream stream(inp);
+    auto parser = ExpressionParser::parseStream(stream);
+    const double expected = parser.getTree().evaluate();
+
+    Tester::instance().setLastQuery(inp);
+    simplifyTree(parser.getTree());
+
+    if (countNodes(parser.getTree().getRoot()) != 2 || !bitwiseEqual(parser.getTree().evaluate(), expected))
+      throw TestFailed("a single leaf", std::to_string(countNodes(parser.getTree().getRoot()) - 1) + " nodes");
+  }
+}
+
+// make test DECIMAL_ITERATIONS=... for a longer run against strtod
+#ifndef DECIMAL_TEST_ITERATIONS
+#define DECIMAL_TEST_ITERATIONS 1000000
+#endif
+
+TEST(decimal_conversion) {
+  std::mt19937_64 random(2016);
+  std::string inp, reference;
+
+  for (long i = 0; i < DECIMAL_TEST_ITERATIONS; ++i) {
+    /* Mostly everyday numbers, then the 128-bit path, then long ones
+       and ones close to the subnormal and overflow ranges */
+    std::size_t intDigits, fracDigits, zeros = 0;
+    switch (i % 16) {
+    case 12: intDigits = random() % 20; fracDigits = random() % 20; break;
+    case 13: intDigits = random() % 60; fracDigits = random() % 60; break;
+    case 14: intDigits = 0; zeros = 300 + random() % 30; fracDigits = zeros + 1 + random() % 20; break;
+    case 15: intDigits = i % 1024 == 15 ? random() % 400 : 300 + random() % 12;
+      fracDigits = i % 1024 == 15 ? random() % 900 : random() % 3; break;
+    default: intDigits = random() % 8; fracDigits = random() % 8;
+    }
+
+    inp.clear();
+    for (std::size_t d = 0; d < intDigits; ++d)
+      inp.push_back('0' + random() % 10);
+    if (fracDigits || !intDigits)
+      inp.push_back(random() % 2 ? '.' : ',');
+    for (std::size_t d = 0; d < fracDigits; ++d)
+      inp.push_back(d < zeros ? '0' : '0' + random() % 10);
+
+    reference = inp;
+    for (auto& c : reference)
+      if (c == ',')
+	c = '.';
+
+    const double result = decimalToDouble(inp.data(), inp.data() + inp.size());
+    const double expected = std::strtod(reference.c_str(), nullptr);
+
+    if (!bitwiseEqual(result, expected)) {
+      Tester::instance().setLastQuery(inp);
+
+      std::ostringstream resStr, expStr;
+      resStr << std::setprecision(17) << result;
+      expStr << std::setprecision(17) << expected;
+      throw TestFailed(expStr.str(), resStr.str());
+    }
+  }
+
+  // Exact halfway points between neighbouring doubles round to even
+  const std::vector<std::pair<std::string, double>> cases = {
+    { "9007199254740993", 9007199254740992.0 },
+    { "9007199254740995", 9007199254740996.0 },
+    { "0,1000000000000000055511151231257827021181583404541015625", 0.1 }
+  };
+
+  for (const auto& c : cases) {
+    Tester::instance().setLastQuery(c.first);
+    const double result = decimalToDouble(c.first.data(), c.first.data() + c.first.size());
+
+    if (!bitwiseEqual(result, c.second))
+      throw TestFailed(std::to_string(c.second), std::to_string(result));
+  }
+}
+
+// The stream-based formatter calc used to have
+std::string formatWithStream(const double val) {
+  std::ostringstream stream;
+  stream << std::setprecision(2) << std::fixed << val;
+
+  std::string result = stream.str();
+  auto rIt = result.rbegin();
+  while (*rIt == '0') ++rIt;
+  if (*rIt == '.')
+    ++rIt;
+
+  result.erase(rIt.base(), result.end());
+  return result;
+}
+
+TEST(result_formatting) {
+  std::mt19937_64 random(2016);
+  std::vector<double> values = {
+    0.0, -0.0, 0.125, 0.375, 2.675, 0.005, 0.004, -0.001, 1.0 / 3, 100, 1e20, -1e300,
+    18446744073709551615.0, 18446744073709551616.0, 5e-324, INFINITY, -INFINITY, NAN
+  };
+
+  for (int i = 0; i < 100000; ++i) {
+    // Whole bit patterns, hundredths with ties and everyday magnitudes
+    std::uint64_t bits = random();
+    double val;
+    std::memcpy(&val, &bits, sizeof(val));
+    values.push_back(val);
+    values.push_back((static_cast<double>(random() % 2000000) - 1000000) / 1000);
+    values.push_back(std::ldexp(static_cast<double>(random() % 4096), randInt(-12, 70)));
+  }
+
+  char buffer[formatBufferSize];
+  for (const double val : values) {
+    const std::string expected = formatWithStream(val);
+    const std::string result(buffer, formatDouble(val, buffer));
+
+    if (result != expected) {
+      std::ostringstream query;
+      query << std::setprecision(17) << val;
+      Tester::instance().setLastQuery(query.str());
+      throw TestFailed(expected, result);
+    }
+  }
+}
+
 int main() {
   RUNTEST(fundamental_equality);
   RUNTEST(operator_priorities);
@@ -324,8 +1609,30 @@ int main() {
   RUNTEST(non_integers);
   RUNTEST(exceptional_cases);
   RUNTEST(bad_cases);
+  RUNTEST(compiled_expressions);
+  RUNTEST(jit_compilation);
+  RUNTEST(literal_expressions);
+  RUNTEST(common_subexpressions);
+  RUNTEST(expression_library);
+  RUNTEST(arena_allocation);
+  RUNTEST(buffer_parsing);
+  RUNTEST(deep_nesting);
+  RUNTEST(huge_trees);
+  RUNTEST(incremental_evaluation);
+  RUNTEST(prepared_expressions);
 
   RUNTEST(randomized_tests);
+  RUNTEST(batch_mode);
+  RUNTEST(result_cache);
+  RUNTEST(statistics);
+  RUNTEST(socket_server);
+  RUNTEST(pipeline);
+  RUNTEST(parallel_evaluation);
+  RUNTEST(streaming_evaluation);
+  RUNTEST(compact_trees);
+  RUNTEST(simplification);
+  RUNTEST(decimal_conversion);
+  RUNTEST(result_formatting);
 
   return Tester::instance().statistics();
 }
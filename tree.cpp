@@ -1,11 +1,17 @@
 #include <stdexcept>
+#include <utility>
 
 #include "tree.h"
 #include "exceptions.h"
 
-void TreeNode::addChildRoutine(TreeNode** ptrToChild, TreeNode* node) {
-  delete *ptrToChild;
+void TreeNode::invalidate() {
+  // Above a dirty node everything is dirty already
+  for (TreeNode* node = this; node && !node->dirty_; node = node->parent_)
+    node->dirty_ = true;
+}
 
+void TreeNode::addChildRoutine(TreeNode** ptrToChild, TreeNode* node) {
+  invalidate();
   *ptrToChild = node;
   if (node)
     node->setParent(this);
@@ -13,6 +19,7 @@ void TreeNode::addChildRoutine(TreeNode** ptrToChild, TreeNode* node) {
 
 TreeNode* TreeNode::popChildRoutine(TreeNode** ptrToChild) {
   TreeNode* oldChild = *ptrToChild;
+  invalidate();
 
   if (oldChild) {
     oldChild->setParent(nullptr);
@@ -22,6 +29,108 @@ TreeNode* TreeNode::popChildRoutine(TreeNode** ptrToChild) {
   return oldChild;
 }
 
+// Left operands waiting for the right ones, on the C++ stack while few
+class ValueStack {
+public:
+  void push(const double value) {
+    if (size_ < localSize)
+      local_[size_] = value;
+    else
+      spilled_.push_back(value);
+
+    ++size_;
+  }
+
+  double pop() {
+    if (--size_ < localSize)
+      return local_[size_];
+
+    const double value = spilled_.back();
+    spilled_.pop_back();
+    return value;
+  }
+
+private:
+  static const std::size_t localSize = 64;
+
+  double local_[localSize];
+  std::vector<double> spilled_;
+  std::size_t size_ = 0;
+};
+
+static const TreeNode* firstChild(const TreeNode* node) {
+  switch (node->getKind()) {
+  case NodeKind::Root:
+    if (!node->filled())
+      throw std::runtime_error("Evaluating an empty tree");
+    return static_cast<const RootNode*>(node)->getChild();
+
+  case NodeKind::Group:
+    if (!node->filled())
+      throw std::runtime_error("Evaluating an empty group");
+    return static_cast<const GroupNode*>(node)->getChild();
+
+  case NodeKind::Unary:
+    if (!node->filled())
+      throw std::runtime_error("Evaluating unary node without an operand");
+    return static_cast<const UnaryNode*>(node)->getChild();
+
+  case NodeKind::Binary:
+    if (!node->filled())
+      throw std::runtime_error("Evaluating binary node without operand(s)");
+    return static_cast<const BinaryNode*>(node)->getLeftChild();
+
+  default:
+    return nullptr;
+  }
+}
+
+/* Post-order walk along the parent links, so that the depth of the
+   tree costs no C++ stack: only pending left operands are stored.
+   Clean subtrees are not entered, their cached values are used. */
+static double evaluateSubtree(const TreeNode* top) {
+  ValueStack values;
+  const TreeNode* node = top;
+
+  for (;;) {
+    // Down to the leftmost operand that has to be evaluated
+    while (node->isDirty())
+      if (const TreeNode* child = firstChild(node))
+	node = child;
+      else
+	break;
+
+    double value = node->isDirty() ? node->evaluate() : node->getCachedValue();
+
+    // Up while the node is the last child of its parent
+    for (;;) {
+      if (node == top)
+	return value;
+
+      const TreeNode* parent = node->getParent();
+      bool dirty = node->isDirty();
+
+      if (parent->getKind() == NodeKind::Unary)
+	value = static_cast<const UnaryNode*>(parent)->getOperator()(value);
+      else if (parent->getKind() == NodeKind::Binary) {
+	const BinaryNode* binary = static_cast<const BinaryNode*>(parent);
+
+	if (node == binary->getLeftChild()) {
+	  values.push(value);
+	  node = binary->getRightChild();
+	  break;
+	}
+
+	value = binary->getOperator()(values.pop(), value);
+	dirty = dirty || binary->getLeftChild()->isDirty();
+      }
+
+      parent->setCachedValue(value, dirty);
+      node = parent;
+    }
+  }
+}
+
 short Operator::binaryPriority() const {
   switch (type_) {
   case '+':
@@ -78,16 +187,15 @@ TreeNode* RootNode::popChild() {
   return popChildRoutine(&firstChild_);
 }
 
-RootNode::~RootNode() {
-  delete firstChild_;
+double RootNode::evaluate() const {
+  return evaluateSubtree(this);
 }
 
-double RootNode::evaluate() const {
-  // Empty expression evaluates to zero
-  if (!filled())
-    throw std::runtime_error("Evaluating an empty tree");
+void Leaf::setValue(const OperandType& value) {
+  value_ = value;
 
-  return firstChild_->evaluate();
+  if (getParent())
+    getParent()->invalidate();
 }
 
 short Leaf::getPriority() const {
@@ -102,8 +210,34 @@ TreeNode* Leaf::popChild() {
   throw std::runtime_error("Leafs have no children");
 }
 
-UnaryNode::~UnaryNode() {
-  delete child_;
+short Variable::getPriority() const {
+  throw std::runtime_error("Variables have no priority");
+}
+
+void Variable::addChild(TreeNode*) {
+  throw std::runtime_error("Variables have no children");
+}
+
+TreeNode* Variable::popChild() {
+  throw std::runtime_error("Variables have no children");
+}
+
+std::size_t VariableTable::lookup(const std::string& name) {
+  for (std::size_t i = 0; i < names_.size(); ++i)
+    if (names_[i] == name)
+      return i;
+
+  names_.push_back(name);
+  values_.push_back(0);
+  return names_.size() - 1;
+}
+
+std::size_t VariableTable::find(const std::string& name) const {
+  for (std::size_t i = 0; i < names_.size(); ++i)
+    if (names_[i] == name)
+      return i;
+
+  throw std::out_of_range("Unknown variable " + name);
 }
 
 void UnaryNode::addChild(TreeNode* node) {
@@ -115,15 +249,7 @@ TreeNode* UnaryNode::popChild() {
 }
 
 double UnaryNode::evaluate() const {
-  if (!filled())
-    throw std::runtime_error("Evaluating unary node without an operand");
-
-  return operator_(child_->evaluate());
-}
-
-BinaryNode::~BinaryNode() {
-  delete leftChild_;
-  delete rightChild_;
+  return evaluateSubtree(this);
 }
 
 void BinaryNode::addChild(TreeNode* node) {
@@ -141,22 +267,35 @@ TreeNode* BinaryNode::popChild() {
 }
 
 double BinaryNode::evaluate() const {
-  if (!filled())
-    throw std::runtime_error("Evaluating binary node without operand(s)");
+  return evaluateSubtree(this);
+}
 
-  return operator_(leftChild_->evaluate(),
-		   rightChild_->evaluate());
+void GroupNode::addChild(TreeNode* node) {
+  addChildRoutine(&child_, node);
 }
 
-EvaluationTree::EvaluationTree(): root_(new RootNode()), insertionPoint_(root_) { }
+TreeNode* GroupNode::popChild() {
+  return popChildRoutine(&child_);
+}
 
-EvaluationTree::~EvaluationTree() {
-  delete root_;
+double GroupNode::evaluate() const {
+  return evaluateSubtree(this);
 }
 
-EvaluationTree::EvaluationTree(EvaluationTree&& rhs): root_(rhs.root_), insertionPoint_(rhs.insertionPoint_) {
+EvaluationTree::EvaluationTree(): ownArena_(new NodeArena()), arena_(ownArena_.get()),
+				   root_(arena_->create<RootNode>()), insertionPoint_(root_) { }
+
+EvaluationTree::EvaluationTree(NodeArena& arena): arena_(&arena),
+						  root_(arena_->create<RootNode>()), insertionPoint_(root_) { }
+
+EvaluationTree::EvaluationTree(EvaluationTree&& rhs): ownArena_(std::move(rhs.ownArena_)), arena_(rhs.arena_),
+						      root_(rhs.root_), insertionPoint_(rhs.insertionPoint_),
+						      openGroup_(rhs.openGroup_), freeGroups_(rhs.freeGroups_) {
+  rhs.arena_ = nullptr;
   rhs.root_ = nullptr;
   rhs.insertionPoint_ = nullptr;
+  rhs.openGroup_ = nullptr;
+  rhs.freeGroups_ = nullptr;
 }
 
 
@@ -168,13 +307,20 @@ void EvaluationTree::insertOperand(const OperandType& arg) {
   if (insertionPoint_->filled())
     throw Exceptions::UnexpectedOperand();
   
-  insertionPoint_->addChild(new Leaf(arg));
+  insertionPoint_->addChild(arena_->create<Leaf>(arg));
+}
+
+void EvaluationTree::insertVariable(const VariableTable& table, const std::size_t index) {
+  if (insertionPoint_->filled())
+    throw Exceptions::UnexpectedOperand();
+  
+  insertionPoint_->addChild(arena_->create<Variable>(table, index));
 }
 
 void EvaluationTree::insertOperator(const Operator& arg) {
   if (!insertionPoint_->filled()) {
     if (arg.canBeUnary()) {
-      TreeNode* newOperation = new UnaryNode(arg);
+      TreeNode* newOperation = arena_->create<UnaryNode>(arg);
       insertionPoint_->addChild(newOperation);
       insertionPoint_ = newOperation;
     }
@@ -187,7 +333,7 @@ void EvaluationTree::insertOperator(const Operator& arg) {
       ascend();
       
     TreeNode* oldChild = insertionPoint_->popChild();
-    TreeNode* newChild = new BinaryNode(arg);
+    TreeNode* newChild = arena_->create<BinaryNode>(arg);
     newChild->addChild(oldChild);
     insertionPoint_->addChild(newChild);
 
@@ -201,3 +347,66 @@ void EvaluationTree::insertSubTree(const EvaluationTree& subtree) {
 
   insertionPoint_->addChild(subtree.getRoot()->popChild());
 }
+
+void EvaluationTree::openGroup() {
+  if (insertionPoint_->filled())
+    throw Exceptions::UnexpectedOperand();
+
+  GroupNode* group = freeGroups_;
+  if (group)
+    freeGroups_ = group->getOuter();
+  else
+    group = arena_->create<GroupNode>();
+
+  group->setOuter(openGroup_);
+  openGroup_ = group;
+
+  insertionPoint_->addChild(group);
+  insertionPoint_ = group;
+}
+
+void EvaluationTree::closeGroup() {
+  GroupNode* group = openGroup_;
+
+  if (!group->filled() || !isReady())
+    throw Exceptions::UnexpectedExpressionEnd();
+
+  // The group is the last child its parent got, so it pops first
+  TreeNode* parent = group->getParent();
+  parent->popChild();
+  parent->addChild(group->popChild());
+  insertionPoint_ = parent;
+
+  openGroup_ = group->getOuter();
+  group->setOuter(freeGroups_);
+  freeGroups_ = group;
+}
+
+std::vector<Leaf*> EvaluationTree::getLeaves() const {
+  std::vector<Leaf*> leaves;
+  std::vector<TreeNode*> pending(1, root_);
+
+  // Right children go first onto the stack, so left ones come out first
+  while (!pending.empty()) {
+    TreeNode* node = pending.back();
+    pending.pop_back();
+
+    // Unfinished trees have empty slots
+    if (!node)
+      continue;
+
+    switch (node->getKind()) {
+    case NodeKind::Root: pending.push_back(static_cast<RootNode*>(node)->getChild()); break;
+    case NodeKind::Group: pending.push_back(static_cast<GroupNode*>(node)->getChild()); break;
+    case NodeKind::Unary: pending.push_back(static_cast<UnaryNode*>(node)->getChild()); break;
+    case NodeKind::Binary:
+      pending.push_back(static_cast<BinaryNode*>(node)->getRightChild());
+      pending.push_back(static_cast<BinaryNode*>(node)->getLeftChild());
+      break;
+    case NodeKind::Leaf: leaves.push_back(static_cast<Leaf*>(node)); break;
+    default: break;
+    }
+  }
+
+  return leaves;
+}
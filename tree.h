@@ -1,12 +1,29 @@
 #ifndef __TREE_H__
 #define __TREE_H__
 
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "arena.h"
+
 using OperandType = double;
 
+enum class NodeKind {
+  Root,
+  Unary,
+  Binary,
+  Leaf,
+  Variable,
+  Group
+};
+
 class TreeNode {
 public:
   virtual ~TreeNode() = default;
 
+  virtual NodeKind getKind() const = 0;
+
   TreeNode* getParent() const { 
     return parent_;
   }
@@ -23,12 +40,36 @@ public:
   virtual bool filled() const = 0;
   virtual double evaluate() const = 0;
 
+  /* Every node keeps the value it evaluated to. A dirty node has to
+     be evaluated anew, and so have its ancestors: marking a node
+     dirty marks the path up to the root. */
+  bool isDirty() const {
+    return dirty_;
+  }
+
+  const OperandType& getCachedValue() const {
+    return value_;
+  }
+
+  // Evaluation stores the value; the node stays dirty if asked to
+  void setCachedValue(const OperandType& value, const bool dirty) const {
+    value_ = value;
+    dirty_ = dirty;
+  }
+
+  void invalidate();
+
 protected:
+  TreeNode(const bool dirty = true): dirty_(dirty) { }
+
   void addChildRoutine(TreeNode** ptrToChild, TreeNode*);
   TreeNode* popChildRoutine(TreeNode** ptrToChild);
 
+  mutable OperandType value_ = 0;
+
 private:
-  TreeNode* parent_;
+  TreeNode* parent_ = nullptr;
+  mutable bool dirty_;
 };
 
 class Operator {
@@ -40,6 +81,10 @@ public:
 
   bool canBeUnary() const;
 
+  char getSymbol() const {
+    return type_;
+  }
+
   double operator()(const double) const;
   double operator()(const double, const double) const;
 
@@ -47,9 +92,13 @@ private:
   char type_;
 };
 
+/* Nodes are allocated from the tree's NodeArena and do not own their
+   children: the arena releases the whole tree at once. */
 class RootNode: public TreeNode {
 public:
-  ~RootNode() override;
+  NodeKind getKind() const override {
+    return NodeKind::Root;
+  }
 
   short getPriority() const override;
 
@@ -61,6 +110,10 @@ public:
   }
   double evaluate() const override;
 
+  TreeNode* getChild() const {
+    return firstChild_;
+  }
+
 private:
   TreeNode* firstChild_ = nullptr;
 };
@@ -68,7 +121,10 @@ private:
 class UnaryNode: public TreeNode {
 public:
   UnaryNode(const Operator& arg): operator_(arg) { }
-  ~UnaryNode() override;
+
+  NodeKind getKind() const override {
+    return NodeKind::Unary;
+  }
 
   short getPriority() const override {
     return operator_.unaryPriority();
@@ -82,6 +138,14 @@ public:
   }
   double evaluate() const override;
 
+  const Operator& getOperator() const {
+    return operator_;
+  }
+
+  TreeNode* getChild() const {
+    return child_;
+  }
+
 private:
   Operator operator_;
   TreeNode* child_ = nullptr;
@@ -91,7 +155,9 @@ class BinaryNode: public TreeNode {
 public:
   BinaryNode(const Operator& arg): operator_(arg) { }
 
-  ~BinaryNode() override;
+  NodeKind getKind() const override {
+    return NodeKind::Binary;
+  }
 
   short getPriority() const override {
     return operator_.binaryPriority();
@@ -105,6 +171,18 @@ public:
   }
   double evaluate() const override;
 
+  const Operator& getOperator() const {
+    return operator_;
+  }
+
+  TreeNode* getLeftChild() const {
+    return leftChild_;
+  }
+
+  TreeNode* getRightChild() const {
+    return rightChild_;
+  }
+
 private:
   Operator operator_;
 
@@ -114,7 +192,77 @@ private:
 
 class Leaf: public TreeNode {
 public:
-  Leaf(const OperandType& operand): content_(operand) { }
+  Leaf(const OperandType& operand): TreeNode(false) {
+    value_ = operand;
+  }
+
+  NodeKind getKind() const override {
+    return NodeKind::Leaf;
+  }
+
+  short getPriority() const override;
+
+  void addChild(TreeNode*) override;
+  TreeNode* popChild() override;
+
+  bool filled() const override {
+    return true; 
+  }
+  double evaluate() const override { 
+    return value_;
+  }
+
+  const OperandType& getValue() const {
+    return value_;
+  }
+
+  // Only the path from here to the root gets evaluated again
+  void setValue(const OperandType&);
+};
+
+/* Names and current values of the variables of prepared expressions.
+   Variables are numbered in the order of their first appearance.
+   Nodes cannot tell when a variable gets bound, so Variable nodes are
+   dirty for good and whatever depends on them is evaluated each time. */
+class VariableTable {
+public:
+  // Registers the name on first use
+  std::size_t lookup(const std::string&);
+  // Throws std::out_of_range for unknown names
+  std::size_t find(const std::string&) const;
+
+  std::size_t size() const {
+    return names_.size();
+  }
+
+  const std::string& getName(const std::size_t index) const {
+    return names_[index];
+  }
+
+  void bind(const std::size_t index, const OperandType& value) {
+    values_[index] = value;
+  }
+
+  const OperandType& getValue(const std::size_t index) const {
+    return values_[index];
+  }
+
+  const OperandType* getValues() const {
+    return values_.data();
+  }
+
+private:
+  std::vector<std::string> names_;
+  std::vector<OperandType> values_;
+};
+
+class Variable: public TreeNode {
+public:
+  Variable(const VariableTable& table, const std::size_t index): table_(table), index_(index) { }
+
+  NodeKind getKind() const override {
+    return NodeKind::Variable;
+  }
 
   short getPriority() const override;
 
@@ -125,35 +273,101 @@ public:
     return true; 
   }
   double evaluate() const override { 
-    return content_;
+    return table_.getValue(index_);
+  }
+
+  std::size_t getIndex() const {
+    return index_;
   }
 
 private:
-  OperandType content_;
+  const VariableTable& table_;
+  std::size_t index_;
+};
+
+/* An open parenthesis while its contents are being parsed. It stops
+   operators from climbing above it, as the root does, and is spliced
+   out of the tree once closed. Open groups are chained innermost
+   first; the closed ones are kept on a free list for reuse. */
+class GroupNode: public TreeNode {
+public:
+  NodeKind getKind() const override {
+    return NodeKind::Group;
+  }
+
+  short getPriority() const override {
+    return 0;
+  }
+
+  void addChild(TreeNode* node) override;
+  TreeNode* popChild() override;
+
+  bool filled() const override {
+    return child_;
+  }
+  double evaluate() const override;
+
+  TreeNode* getChild() const {
+    return child_;
+  }
+
+  GroupNode* getOuter() const {
+    return outer_;
+  }
+
+  void setOuter(GroupNode* outer) {
+    outer_ = outer;
+  }
+
+private:
+  TreeNode* child_ = nullptr;
+  GroupNode* outer_ = nullptr;
 };
 
 class EvaluationTree {
 public:
   EvaluationTree();
-  ~EvaluationTree();
+  // Nodes go to a shared arena which the caller resets between trees
+  explicit EvaluationTree(NodeArena&);
   EvaluationTree(const EvaluationTree&) = delete;
 
   EvaluationTree(EvaluationTree&&);
 
+  /* Evaluates what has changed since the last time, which is the
+     whole tree on the first run. Not to be run on the same tree from
+     several threads at once, as the cached values get updated. */
   double evaluate() const {
     return root_->evaluate();
   }
 
+  // Operands in the order they were inserted, to update in place
+  std::vector<Leaf*> getLeaves() const;
+
   bool isReady() const;
 
   void insertOperand(const OperandType&);
+  void insertVariable(const VariableTable&, const std::size_t);
   void insertOperator(const Operator&);
+  // The subtree has to be allocated from the same arena
   void insertSubTree(const EvaluationTree&);
 
+  /* Parentheses: the group is inserted as an operand and takes what
+     follows until closed. Closing an incomplete group throws. */
+  void openGroup();
+  void closeGroup();
+
+  bool groupOpen() const {
+    return openGroup_;
+  }
+
   TreeNode* getRoot() const {
     return root_;
   }
 
+  NodeArena& getArena() const {
+    return *arena_;
+  }
+
   bool rootReached() const {
     return insertionPoint_ == root_;
   }
@@ -163,8 +377,14 @@ public:
   }
 
 private:
+  std::unique_ptr<NodeArena> ownArena_;
+  NodeArena* arena_;
+
   TreeNode* root_;
   TreeNode* insertionPoint_;
+
+  GroupNode* openGroup_ = nullptr;
+  GroupNode* freeGroups_ = nullptr;
 };
 
 #endif